@@ -0,0 +1,113 @@
+#include "base/aho_corasick.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <deque>
+
+namespace base {
+
+AhoCorasickMatcher::AhoCorasickMatcher(
+    const std::vector<std::string>& patterns, bool ignore_case)
+    : num_patterns_(patterns.size()),
+      num_classes_(1) {
+  // Give every byte used by a pattern its own class. Folded letters share
+  // the class of their lower case form.
+  memset(byte_class_, 0, sizeof(byte_class_));
+  for (size_t i = 0; i < patterns.size(); ++i) {
+    for (size_t j = 0; j < patterns[i].size(); ++j) {
+      uint8 c = patterns[i][j];
+      if (ignore_case)
+        c = tolower(c);
+      if (byte_class_[c] == 0)
+        byte_class_[c] = static_cast<uint16>(num_classes_++);
+    }
+  }
+  if (ignore_case) {
+    for (int c = 'A'; c <= 'Z'; ++c)
+      byte_class_[c] = byte_class_[tolower(c)];
+  }
+
+  // Build the trie; -1 marks a missing edge.
+  next_.assign(num_classes_, -1);
+  match_.assign(1, -1);
+  for (size_t i = 0; i < patterns.size(); ++i) {
+    int32 state = 0;
+    for (size_t j = 0; j < patterns[i].size(); ++j) {
+      const size_t edge = state * num_classes_ +
+                          byte_class_[static_cast<uint8>(patterns[i][j])];
+      if (next_[edge] < 0) {
+        next_[edge] = static_cast<int32>(match_.size());
+        match_.push_back(-1);
+        next_.resize(next_.size() + num_classes_, -1);
+      }
+      state = next_[edge];
+    }
+    if (match_[state] < 0)
+      match_[state] = static_cast<int32>(i);
+  }
+
+  // Breadth first, fill in the missing edges from the failure links so
+  // every state has a transition on every class. A state without a pattern
+  // of its own inherits the match of its failure state, the longest proper
+  // suffix that is a trie state.
+  std::vector<int32> fail(match_.size(), 0);
+  std::deque<int32> queue;
+  for (int cls = 0; cls < num_classes_; ++cls) {
+    int32& edge = next_[cls];
+    if (edge < 0)
+      edge = 0;
+    else
+      queue.push_back(edge);
+  }
+  while (!queue.empty()) {
+    const int32 state = queue.front();
+    queue.pop_front();
+    if (match_[state] < 0)
+      match_[state] = match_[fail[state]];
+    for (int cls = 0; cls < num_classes_; ++cls) {
+      const int32 fallback = next_[fail[state] * num_classes_ + cls];
+      int32& edge = next_[state * num_classes_ + cls];
+      if (edge < 0) {
+        edge = fallback;
+      } else {
+        fail[edge] = fallback;
+        queue.push_back(edge);
+      }
+    }
+  }
+
+  // Store row offsets instead of state numbers to save a multiply per
+  // byte, and complement the edges into states with a match so the scan
+  // loop tests the value it already loaded.
+  for (size_t i = 0; i < next_.size(); ++i) {
+    const int32 target = next_[i];
+    next_[i] = target * num_classes_;
+    if (match_[target] >= 0)
+      next_[i] = ~next_[i];
+  }
+}
+
+int AhoCorasickMatcher::Find(const StringPiece& text, size_t* end) const {
+  if (match_[0] >= 0) {
+    if (end)
+      *end = 0;
+    return match_[0];
+  }
+
+  const uint8* const begin = reinterpret_cast<const uint8*>(text.data());
+  const uint8* const limit = begin + text.size();
+  const int32* const next = &next_[0];
+  int32 offset = 0;
+  for (const uint8* p = begin; p < limit; ++p) {
+    offset = next[offset + byte_class_[*p]];
+    if (offset < 0) {
+      if (end)
+        *end = p + 1 - begin;
+      return match_[~offset / num_classes_];
+    }
+  }
+  return -1;
+}
+
+}  // namespace base
@@ -0,0 +1,63 @@
+// Description : Aho-Corasick automaton that finds which of many strings occur
+//               in a text in a single pass. The automaton is compiled into a
+//               dense transition table over byte classes, so matching costs
+//               one table lookup per byte of text however many patterns
+//               there are.
+//
+// Usage:
+//   std::vector<std::string> patterns;
+//   patterns.push_back("timeout");
+//   patterns.push_back("connection reset");
+//   base::AhoCorasickMatcher matcher(patterns, true);
+//   if (matcher.Contains(line)) ...
+
+#ifndef PUBLIC_BASE_AHO_CORASICK_H_
+#define PUBLIC_BASE_AHO_CORASICK_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/string_piece.h"
+
+namespace base {
+
+class AhoCorasickMatcher {
+ public:
+  // Compiles |patterns|. With |ignore_case|, ASCII letters match either
+  // case. An empty pattern matches every text.
+  AhoCorasickMatcher(const std::vector<std::string>& patterns,
+                     bool ignore_case);
+
+  // True if any pattern occurs in |text|.
+  bool Contains(const StringPiece& text) const {
+    return Find(text, NULL) >= 0;
+  }
+
+  // Returns the index of a pattern ending earliest in |text|, or -1 if none
+  // occurs. If |end| is not NULL it is set to the offset just past the
+  // match. When several patterns end at the same offset, the longest one
+  // is reported.
+  int Find(const StringPiece& text, size_t* end) const;
+
+  size_t num_patterns() const { return num_patterns_; }
+  size_t num_states() const { return match_.size(); }
+
+ private:
+  size_t num_patterns_;
+  int num_classes_;
+  // Maps a byte to its class. Bytes that appear in no pattern share class 0.
+  uint16 byte_class_[256];
+  // next_[state * num_classes_ + class] is the row offset, state times
+  // num_classes_, of the state after reading a byte of |class| in |state|.
+  // It is complemented if that state has a match. The start state is 0.
+  std::vector<int32> next_;
+  // Pattern recognized on entering each state, -1 if none.
+  std::vector<int32> match_;
+
+  DISALLOW_COPY_AND_ASSIGN(AhoCorasickMatcher);
+};
+
+}  // namespace base
+
+#endif  // PUBLIC_BASE_AHO_CORASICK_H_
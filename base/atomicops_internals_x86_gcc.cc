@@ -25,12 +25,21 @@
        "xchg %%rdi, %%rbx\n"   \
        : "=a" (a), "=D" (b), "=c" (c), "=d" (d) : "a" (inp))
 
+// Same as cpuid, for leaves that take a subleaf in %ecx.
+#define cpuid_count(a, b, c, d, inp, count) \
+  asm ("mov %%rbx, %%rdi\n"                 \
+       "cpuid\n"                            \
+       "xchg %%rdi, %%rbx\n"                \
+       : "=a" (a), "=D" (b), "=c" (c), "=d" (d) : "a" (inp), "c" (count))
+
 // Set the flags so that code will run correctly and conservatively, so even
 // if we haven't been initialized yet, we're probably single threaded, and our
 // default values should hopefully be pretty safe.
 struct AtomicOps_x86CPUFeatureStruct AtomicOps_Internalx86CPUFeatures = {
   false,          // bug can't exist before process spawns multiple threads
   false,          // no SSE2
+  false,          // no SSE4.2
+  false,          // no AVX2
 };
 
 // Initialize the AtomicOps_Internalx86CPUFeatures struct.
@@ -42,6 +51,7 @@ static void AtomicOps_Internalx86CPUFeaturesInit() {
 
   // Get vendor string (issue CPUID with eax = 0)
   cpuid(eax, ebx, ecx, edx, 0);
+  const uint32 max_leaf = eax;
   char vendor[13];
   memcpy(vendor, &ebx, 4);
   memcpy(vendor + 4, &edx, 4);
@@ -73,6 +83,24 @@ static void AtomicOps_Internalx86CPUFeaturesInit() {
 
   // edx bit 26 is SSE2 which we use to tell use whether we can use mfence
   AtomicOps_Internalx86CPUFeatures.has_sse2 = ((edx >> 26) & 1);
+
+  // ecx bit 20 is SSE4.2, which has the crc32 instruction.
+  AtomicOps_Internalx86CPUFeatures.has_sse42 = ((ecx >> 20) & 1);
+
+  // AVX2 needs the OS to save the YMM registers: ecx bit 27 is OSXSAVE and
+  // XCR0 bits 1 and 2 are the SSE and AVX state. The AVX2 flag itself is
+  // ebx bit 5 of leaf 7.
+  bool has_avx2 = false;
+  if (((ecx >> 27) & 1) && ((ecx >> 28) & 1) && max_leaf >= 7) {
+    uint32 xcr0_low;
+    uint32 xcr0_high;
+    asm ("xgetbv" : "=a" (xcr0_low), "=d" (xcr0_high) : "c" (0));
+    if ((xcr0_low & 6) == 6) {
+      cpuid_count(eax, ebx, ecx, edx, 7, 0);
+      has_avx2 = (ebx >> 5) & 1;
+    }
+  }
+  AtomicOps_Internalx86CPUFeatures.has_avx2 = has_avx2;
 }
 
 namespace {
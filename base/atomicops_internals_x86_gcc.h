@@ -15,6 +15,9 @@ struct AtomicOps_x86CPUFeatureStruct {
   bool has_amd_lock_mb_bug; // Processor has AMD memory-barrier bug; do lfence
                             // after acquire compare-and-swap.
   bool has_sse2;            // Processor has SSE2.
+  bool has_sse42;           // Processor has SSE4.2.
+  bool has_avx2;            // Processor has AVX2 and the OS saves the YMM
+                            // registers.
 };
 extern struct AtomicOps_x86CPUFeatureStruct AtomicOps_Internalx86CPUFeatures;
 
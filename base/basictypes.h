@@ -83,6 +83,9 @@ const  int64 kint64max  = (( int64) GG_LONGLONG(0x7FFFFFFFFFFFFFFF));
   TypeName(const TypeName&);               \
   void operator=(const TypeName&)
 
+// Shorthand for DISALLOW_COPY_AND_ASSIGN.
+#define DISALLOW_COPY(TypeName) DISALLOW_COPY_AND_ASSIGN(TypeName)
+
 // A macro to disallow all the implicit constructors, namely the
 // default constructor, copy constructor and operator= functions.
 //
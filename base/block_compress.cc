@@ -0,0 +1,303 @@
+#include "base/block_compress.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "base/scoped_ptr.h"
+
+namespace {
+
+// Compressed stream layout, one sequence after another:
+//   token      : high nibble = literal count, low nibble = match length - 4.
+//                A nibble of 15 is followed by extension bytes that are
+//                added to it until a byte smaller than 255 is read.
+//   literals   : copied verbatim.
+//   offset     : 2 bytes little endian, distance back to the match start.
+//   match ext  : extension bytes for the match length, if any.
+// The last sequence of a block carries literals only and has no offset.
+const int kMinMatch = 4;
+const int kHashLog = 14;
+const size_t kMaxOffset = 0xFFFF;
+// Matches are not searched for in the last few bytes, so the 4-byte loads in
+// the match finder never run past the end of the input.
+const size_t kLastLiterals = 8;
+
+// Files are split into independent blocks of this many bytes.
+const size_t kFileBlockSize = 256 * 1024;
+const char kFileMagic[4] = { 'B', 'L', 'Z', '1' };
+// Set in the stored length of a block that did not compress.
+const uint32 kStoredRawFlag = 0x80000000U;
+
+inline uint32 Load32(const char* p) {
+  uint32 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32 HashSequence(uint32 seq) {
+  return (seq * 2654435761U) >> (32 - kHashLog);
+}
+
+inline char* WriteLength(char* op, size_t len) {
+  while (len >= 255) {
+    *op++ = static_cast<char>(255);
+    len -= 255;
+  }
+  *op++ = static_cast<char>(len);
+  return op;
+}
+
+char* WriteSequence(char* op, const char* literals, size_t literal_len,
+                    size_t offset, size_t match_len) {
+  char* token = op++;
+  uint8 t = 0;
+  if (literal_len >= 15) {
+    t = 15 << 4;
+    op = WriteLength(op, literal_len - 15);
+  } else {
+    t = static_cast<uint8>(literal_len << 4);
+  }
+  memcpy(op, literals, literal_len);
+  op += literal_len;
+
+  if (match_len != 0) {
+    *op++ = static_cast<char>(offset & 0xFF);
+    *op++ = static_cast<char>(offset >> 8);
+    size_t extra = match_len - kMinMatch;
+    if (extra >= 15) {
+      t |= 15;
+      op = WriteLength(op, extra - 15);
+    } else {
+      t |= static_cast<uint8>(extra);
+    }
+  }
+  *token = static_cast<char>(t);
+  return op;
+}
+
+// Reads an extended length. Returns false if the input ends first.
+inline bool ReadLength(const uint8** ip, const uint8* iend, size_t* len) {
+  uint8 b;
+  do {
+    if (*ip >= iend)
+      return false;
+    b = *(*ip)++;
+    *len += b;
+  } while (b == 255);
+  return true;
+}
+
+bool WriteAll(FILE* f, const void* data, size_t len) {
+  return fwrite(data, 1, len, f) == len;
+}
+
+bool ReadAll(FILE* f, void* data, size_t len) {
+  return fread(data, 1, len, f) == len;
+}
+
+}  // namespace
+
+namespace base {
+
+size_t MaxCompressedBlockLength(size_t len) {
+  return len + len / 255 + 16;
+}
+
+size_t CompressBlock(const char* input, size_t len, char* output) {
+  char* op = output;
+  size_t anchor = 0;
+
+  if (len > kLastLiterals + kMinMatch) {
+    std::vector<uint32> table(1 << kHashLog, 0);
+    const size_t limit = len - kLastLiterals;
+    size_t ip = 1;
+    while (ip < limit) {
+      const uint32 seq = Load32(input + ip);
+      const uint32 h = HashSequence(seq);
+      const size_t ref = table[h];
+      table[h] = static_cast<uint32>(ip);
+
+      if (ref >= ip || ip - ref > kMaxOffset || Load32(input + ref) != seq) {
+        // Skip faster through data that does not compress.
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+
+      size_t match_ip = ip;
+      size_t match_ref = ref;
+      while (match_ip > anchor && match_ref > 0 &&
+             input[match_ip - 1] == input[match_ref - 1]) {
+        --match_ip;
+        --match_ref;
+      }
+      size_t match_len = ip - match_ip + kMinMatch;
+      while (match_ip + match_len < len &&
+             input[match_ref + match_len] == input[match_ip + match_len]) {
+        ++match_len;
+      }
+
+      op = WriteSequence(op, input + anchor, match_ip - anchor,
+                         match_ip - match_ref, match_len);
+      ip = match_ip + match_len;
+      anchor = ip;
+      if (ip < limit && ip >= 2) {
+        table[HashSequence(Load32(input + ip - 2))] =
+            static_cast<uint32>(ip - 2);
+      }
+    }
+  }
+
+  op = WriteSequence(op, input + anchor, len - anchor, 0, 0);
+  return op - output;
+}
+
+bool UncompressBlock(const char* input, size_t len,
+                     char* output, size_t output_len) {
+  const uint8* ip = reinterpret_cast<const uint8*>(input);
+  const uint8* const iend = ip + len;
+  char* op = output;
+  char* const oend = output + output_len;
+
+  while (ip < iend) {
+    const uint8 token = *ip++;
+
+    size_t literal_len = token >> 4;
+    if (literal_len == 15 && !ReadLength(&ip, iend, &literal_len))
+      return false;
+    if (literal_len > static_cast<size_t>(iend - ip) ||
+        literal_len > static_cast<size_t>(oend - op))
+      return false;
+    memcpy(op, ip, literal_len);
+    ip += literal_len;
+    op += literal_len;
+
+    if (ip == iend)
+      break;  // Last sequence, literals only.
+
+    if (iend - ip < 2)
+      return false;
+    const size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+    ip += 2;
+    if (offset == 0 || offset > static_cast<size_t>(op - output))
+      return false;
+
+    size_t match_len = token & 15;
+    if (match_len == 15 && !ReadLength(&ip, iend, &match_len))
+      return false;
+    match_len += kMinMatch;
+    if (match_len > static_cast<size_t>(oend - op))
+      return false;
+
+    const char* ref = op - offset;
+    if (offset >= match_len) {
+      memcpy(op, ref, match_len);
+      op += match_len;
+    } else {
+      // Overlapping copy, e.g. a run of a repeated byte.
+      for (size_t i = 0; i < match_len; ++i)
+        *op++ = *ref++;
+    }
+  }
+
+  return op == oend;
+}
+
+bool CompressFile(const std::string& src_path, const std::string& dst_path) {
+  FILE* src = fopen(src_path.c_str(), "rb");
+  if (src == NULL)
+    return false;
+  FILE* dst = fopen(dst_path.c_str(), "wb");
+  if (dst == NULL) {
+    fclose(src);
+    return false;
+  }
+
+  scoped_array<char> raw(new char[kFileBlockSize]);
+  scoped_array<char> packed(
+      new char[MaxCompressedBlockLength(kFileBlockSize)]);
+
+  bool ok = WriteAll(dst, kFileMagic, sizeof(kFileMagic));
+  while (ok) {
+    const size_t raw_len = fread(raw.get(), 1, kFileBlockSize, src);
+    if (raw_len == 0) {
+      ok = !ferror(src);
+      break;
+    }
+
+    size_t packed_len = CompressBlock(raw.get(), raw_len, packed.get());
+    uint32 header[2] = { static_cast<uint32>(raw_len),
+                         static_cast<uint32>(packed_len) };
+    const char* payload = packed.get();
+    if (packed_len >= raw_len) {
+      header[1] = static_cast<uint32>(raw_len) | kStoredRawFlag;
+      payload = raw.get();
+      packed_len = raw_len;
+    }
+    ok = WriteAll(dst, header, sizeof(header)) &&
+         WriteAll(dst, payload, packed_len);
+  }
+
+  fclose(src);
+  if (fclose(dst) != 0)
+    ok = false;
+  if (!ok)
+    unlink(dst_path.c_str());
+  return ok;
+}
+
+bool UncompressFile(const std::string& src_path, const std::string& dst_path) {
+  FILE* src = fopen(src_path.c_str(), "rb");
+  if (src == NULL)
+    return false;
+  FILE* dst = fopen(dst_path.c_str(), "wb");
+  if (dst == NULL) {
+    fclose(src);
+    return false;
+  }
+
+  scoped_array<char> raw(new char[kFileBlockSize]);
+  scoped_array<char> packed(
+      new char[MaxCompressedBlockLength(kFileBlockSize)]);
+
+  char magic[sizeof(kFileMagic)];
+  bool ok = ReadAll(src, magic, sizeof(magic)) &&
+            memcmp(magic, kFileMagic, sizeof(magic)) == 0;
+  while (ok) {
+    uint32 header[2];
+    const size_t n = fread(header, 1, sizeof(header), src);
+    if (n == 0) {
+      ok = !ferror(src);
+      break;
+    }
+
+    const size_t raw_len = header[0];
+    const bool stored = (header[1] & kStoredRawFlag) != 0;
+    const size_t packed_len = header[1] & ~kStoredRawFlag;
+    if (n != sizeof(header) || raw_len > kFileBlockSize ||
+        packed_len > MaxCompressedBlockLength(kFileBlockSize) ||
+        (stored && packed_len != raw_len)) {
+      ok = false;
+      break;
+    }
+
+    if (stored) {
+      ok = ReadAll(src, raw.get(), raw_len);
+    } else {
+      ok = ReadAll(src, packed.get(), packed_len) &&
+           UncompressBlock(packed.get(), packed_len, raw.get(), raw_len);
+    }
+    ok = ok && WriteAll(dst, raw.get(), raw_len);
+  }
+
+  fclose(src);
+  if (fclose(dst) != 0)
+    ok = false;
+  if (!ok)
+    unlink(dst_path.c_str());
+  return ok;
+}
+
+}  // namespace base
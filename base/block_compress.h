@@ -0,0 +1,39 @@
+// Description : A small, self-contained LZ77 block compressor in the spirit
+//               of LZ4. It trades compression ratio for speed and is meant
+//               for data that is written once and rarely read back, such as
+//               rotated log files.
+
+#ifndef PUBLIC_BASE_BLOCK_COMPRESS_H_
+#define PUBLIC_BASE_BLOCK_COMPRESS_H_
+
+#include <string>
+
+#include "base/basictypes.h"
+
+namespace base {
+
+// Returns the largest size CompressBlock() may produce for |len| input bytes.
+size_t MaxCompressedBlockLength(size_t len);
+
+// Compresses |len| bytes of |input| into |output|, which must have room for
+// at least MaxCompressedBlockLength(len) bytes. Returns the number of bytes
+// written.
+size_t CompressBlock(const char* input, size_t len, char* output);
+
+// Decompresses a block produced by CompressBlock(). |output_len| must be the
+// exact uncompressed size. Returns false if the block is corrupt; |output| may
+// have been partially written in that case.
+bool UncompressBlock(const char* input, size_t len,
+                     char* output, size_t output_len);
+
+// Streams |src_path| into |dst_path| as a sequence of compressed blocks.
+// The destination is created (or truncated) with mode 0644. Returns false on
+// any I/O error, in which case a partially written |dst_path| is removed.
+bool CompressFile(const std::string& src_path, const std::string& dst_path);
+
+// Reverses CompressFile(). Returns false on I/O error or corrupt input.
+bool UncompressFile(const std::string& src_path, const std::string& dst_path);
+
+}  // namespace base
+
+#endif  // PUBLIC_BASE_BLOCK_COMPRESS_H_
@@ -0,0 +1,152 @@
+#include "base/bloom_filter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#include "base/atomicops.h"
+#endif
+
+namespace {
+
+// Odd multipliers turning the low half of a fingerprint into one bit
+// position per word; from the split block Bloom filter of Apache Parquet.
+const uint32 kSalts[8] = {
+  0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+};
+
+const char kMagic[4] = { 'B', 'B', 'F', '1' };
+
+// Bit |i| of the block is the top 6 bits of the salted low half.
+inline uint64 BitMask(uint32 low, int i) {
+  return static_cast<uint64>(1) << ((low * kSalts[i]) >> 26);
+}
+
+#if defined(__x86_64__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+// Tests the eight bits with two 256-bit compares.
+bool BlockContainsAvx2(const uint64* block, uint32 low) {
+  const __m256i salts = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(kSalts));
+  const __m256i positions = _mm256_srli_epi32(
+      _mm256_mullo_epi32(_mm256_set1_epi32(low), salts), 26);
+  const __m256i one = _mm256_set1_epi64x(1);
+  const __m256i mask_lo = _mm256_sllv_epi64(
+      one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(positions)));
+  const __m256i mask_hi = _mm256_sllv_epi64(
+      one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(positions, 1)));
+  const __m256i words_lo = _mm256_load_si256(
+      reinterpret_cast<const __m256i*>(block));
+  const __m256i words_hi = _mm256_load_si256(
+      reinterpret_cast<const __m256i*>(block) + 1);
+  return _mm256_testc_si256(words_lo, mask_lo) &&
+         _mm256_testc_si256(words_hi, mask_hi);
+}
+
+#pragma GCC pop_options
+#endif  // __x86_64__
+
+bool BlockContainsScalar(const uint64* block, uint32 low) {
+  uint64 missing = 0;
+  for (int i = 0; i < 8; ++i)
+    missing |= BitMask(low, i) & ~block[i];
+  return missing == 0;
+}
+
+}  // namespace
+
+namespace base {
+
+BlockedBloomFilter::BlockedBloomFilter(uint64 expected_keys,
+                                       int bits_per_key)
+    : num_blocks_(0), blocks_(NULL) {
+  const uint64 bits = std::max<uint64>(expected_keys, 1) * bits_per_key;
+  CHECK(Allocate(std::max<uint64>(
+      (bits + kBlockBytes * 8 - 1) / (kBlockBytes * 8), 1)));
+  Clear();
+}
+
+BlockedBloomFilter::~BlockedBloomFilter() {
+  free(blocks_);
+}
+
+bool BlockedBloomFilter::Allocate(uint64 num_blocks) {
+  void* memory;
+  if (posix_memalign(&memory, kBlockBytes, num_blocks * kBlockBytes) != 0)
+    return false;
+  free(blocks_);
+  blocks_ = static_cast<uint64*>(memory);
+  num_blocks_ = num_blocks;
+  return true;
+}
+
+uint64* BlockedBloomFilter::BlockFor(uint64 fp) const {
+  // Maps the high half onto [0, num_blocks_) without a division.
+  const uint64 block = ((fp >> 32) * num_blocks_) >> 32;
+  return blocks_ + block * kWordsPerBlock;
+}
+
+void BlockedBloomFilter::InsertFingerprint(uint64 fp) {
+  uint64* block = BlockFor(fp);
+  const uint32 low = static_cast<uint32>(fp);
+  for (int i = 0; i < kWordsPerBlock; ++i)
+    block[i] |= BitMask(low, i);
+}
+
+void BlockedBloomFilter::ConcurrentInsertFingerprint(uint64 fp) {
+  uint64* block = BlockFor(fp);
+  const uint32 low = static_cast<uint32>(fp);
+  for (int i = 0; i < kWordsPerBlock; ++i) {
+    const uint64 mask = BitMask(low, i);
+    if ((__atomic_load_n(&block[i], __ATOMIC_RELAXED) & mask) == 0)
+      __atomic_fetch_or(&block[i], mask, __ATOMIC_RELAXED);
+  }
+}
+
+bool BlockedBloomFilter::MayContainFingerprint(uint64 fp) const {
+  const uint64* block = BlockFor(fp);
+  const uint32 low = static_cast<uint32>(fp);
+#if defined(__x86_64__)
+  if (AtomicOps_Internalx86CPUFeatures.has_avx2)
+    return BlockContainsAvx2(block, low);
+#endif
+  return BlockContainsScalar(block, low);
+}
+
+void BlockedBloomFilter::Clear() {
+  memset(blocks_, 0, num_blocks_ * kBlockBytes);
+}
+
+void BlockedBloomFilter::SerializeTo(std::string* out) const {
+  out->append(kMagic, sizeof(kMagic));
+  out->append(reinterpret_cast<const char*>(&num_blocks_),
+              sizeof(num_blocks_));
+  out->append(reinterpret_cast<const char*>(blocks_),
+              num_blocks_ * kBlockBytes);
+}
+
+bool BlockedBloomFilter::Deserialize(const StringPiece& data) {
+  const size_t header = sizeof(kMagic) + sizeof(uint64);
+  if (data.size() < header || memcmp(data.data(), kMagic, sizeof(kMagic)))
+    return false;
+  uint64 num_blocks;
+  memcpy(&num_blocks, data.data() + sizeof(kMagic), sizeof(num_blocks));
+  if (num_blocks == 0 || (data.size() - header) / kBlockBytes != num_blocks ||
+      (data.size() - header) % kBlockBytes != 0) {
+    return false;
+  }
+  if (!Allocate(num_blocks))
+    return false;
+  memcpy(blocks_, data.data() + header, num_blocks * kBlockBytes);
+  return true;
+}
+
+}  // namespace base
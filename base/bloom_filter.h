@@ -0,0 +1,81 @@
+// Description : Bloom filter blocked by cache line. A key sets eight bits,
+//               one in each 64-bit word of a single 64-byte block picked by
+//               its fingerprint, so a query costs one cache miss however
+//               large the filter is, and the eight bits are tested together
+//               with AVX2 when the processor has it. With 10 bits per key
+//               about 1% of absent keys are reported present.
+//
+// Usage:
+//   base::BlockedBloomFilter filter(num_keys, 10);
+//   filter.Insert(key);
+//   ...
+//   if (filter.MayContain(key))  // Look on disk.
+
+#ifndef PUBLIC_BASE_BLOOM_FILTER_H_
+#define PUBLIC_BASE_BLOOM_FILTER_H_
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/hash.h"
+#include "base/string_piece.h"
+
+namespace base {
+
+class BlockedBloomFilter {
+ public:
+  // Sizes the filter for |expected_keys| at |bits_per_key|.
+  BlockedBloomFilter(uint64 expected_keys, int bits_per_key);
+  ~BlockedBloomFilter();
+
+  // Keys are hashed with Fingerprint(). The *Fingerprint() versions take a
+  // fingerprint computed by the caller, to hash a key once for several
+  // filters.
+  void Insert(const StringPiece& key) { InsertFingerprint(Fingerprint(key)); }
+  void InsertFingerprint(uint64 fp);
+
+  // Insert() that may run concurrently with other ConcurrentInsert() and
+  // MayContain() calls on the same filter.
+  void ConcurrentInsert(const StringPiece& key) {
+    ConcurrentInsertFingerprint(Fingerprint(key));
+  }
+  void ConcurrentInsertFingerprint(uint64 fp);
+
+  // False if the key was never inserted; true if it was, and for a small
+  // fraction of the other keys.
+  bool MayContain(const StringPiece& key) const {
+    return MayContainFingerprint(Fingerprint(key));
+  }
+  bool MayContainFingerprint(uint64 fp) const;
+
+  void Clear();
+
+  uint64 num_blocks() const { return num_blocks_; }
+  size_t size_in_bytes() const { return num_blocks_ * kBlockBytes; }
+
+  // Appends the filter to |out|, to be read back by Deserialize() on a
+  // machine of the same byte order.
+  void SerializeTo(std::string* out) const;
+
+  // Replaces the filter with one written by SerializeTo(). Returns false,
+  // leaving the filter unchanged, if |data| is not such a filter.
+  bool Deserialize(const StringPiece& data);
+
+ private:
+  static const int kBlockBytes = 64;
+  static const int kWordsPerBlock = 8;
+
+  // Replaces the blocks with |num_blocks| uninitialized ones. Returns false,
+  // keeping the old blocks, if memory runs out.
+  bool Allocate(uint64 num_blocks);
+  uint64* BlockFor(uint64 fp) const;
+
+  uint64 num_blocks_;
+  uint64* blocks_;  // Aligned to a cache line.
+
+  DISALLOW_COPY_AND_ASSIGN(BlockedBloomFilter);
+};
+
+}  // namespace base
+
+#endif  // PUBLIC_BASE_BLOOM_FILTER_H_
@@ -0,0 +1,201 @@
+// Description : Hash map shared between threads. Keys are spread over
+//               shards, each a flat_hash_map behind its own RwMutex, so
+//               threads working on different keys rarely meet on a lock and
+//               readers of one shard share it. Every operation locks one
+//               shard at a time; values are copied out, never referenced,
+//               and read-modify-write updates run under the shard lock.
+//
+// Usage:
+//   base::ConcurrentHashMap<std::string, int64> hits(64);
+//   hits.Compute(url, [](int64* count, bool) { ++*count; });
+//   int64 count;
+//   if (hits.Find(url, &count)) ...
+
+#ifndef PUBLIC_BASE_CONCURRENT_HASH_MAP_H_
+#define PUBLIC_BASE_CONCURRENT_HASH_MAP_H_
+
+#include <utility>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/flat_hash_map.h"
+#include "base/mutex.h"
+
+namespace base {
+
+template <typename Key, typename Value, typename Hash = FlatHash<Key>,
+          typename Equal = FlatEqual<Key> >
+class ConcurrentHashMap {
+ public:
+  // |num_shards| is rounded up to a power of two. More shards cost a
+  // little memory and make size() and ForEach() slower, and make it less
+  // likely that two threads want the same lock; a few times the number of
+  // threads is a good start.
+  explicit ConcurrentHashMap(int num_shards = 16)
+      : shard_shift_(64), shards_(NULL), num_shards_(1) {
+    while (num_shards_ < num_shards) {
+      num_shards_ *= 2;
+      --shard_shift_;
+    }
+    shards_ = new Shard[num_shards_];
+  }
+
+  ~ConcurrentHashMap() { delete[] shards_; }
+
+  int num_shards() const { return num_shards_; }
+
+  // Copies the value of |key| to |value| and returns true, or returns false
+  // if |key| is not present. |value| may be NULL.
+  template <typename K>
+  bool Find(const K& key, Value* value) const {
+    const Shard& shard = ShardFor(key);
+    ReaderMutexLock lock(&shard.mutex);
+    typename Map::const_iterator it = shard.map.find(key);
+    if (it == shard.map.end())
+      return false;
+    if (value)
+      *value = it->second;
+    return true;
+  }
+
+  template <typename K>
+  bool Contains(const K& key) const {
+    return Find(key, NULL);
+  }
+
+  // Adds |key| with |value| if |key| is not present. Returns true if it
+  // was added.
+  bool Insert(const Key& key, const Value& value) {
+    Shard& shard = ShardFor(key);
+    WriterMutexLock lock(&shard.mutex);
+    return shard.map.insert(std::make_pair(key, value)).second;
+  }
+
+  // Sets the value of |key| to |value|, adding |key| if needed. Returns true
+  // if it was added.
+  bool Upsert(const Key& key, const Value& value) {
+    Shard& shard = ShardFor(key);
+    WriterMutexLock lock(&shard.mutex);
+    std::pair<typename Map::iterator, bool> result =
+        shard.map.insert(std::make_pair(key, value));
+    if (!result.second)
+      result.first->second = value;
+    return result.second;
+  }
+
+  // Calls |function|(Value* value, bool added) under the lock of the shard
+  // of |key|, adding |key| with a value initialized Value first if it is
+  // not present. Returns whether it was added. |function| must not call
+  // back into the map.
+  template <typename Function>
+  bool Compute(const Key& key, Function function) {
+    Shard& shard = ShardFor(key);
+    WriterMutexLock lock(&shard.mutex);
+    const size_t size = shard.map.size();
+    Value* value = &shard.map[key];
+    const bool added = shard.map.size() != size;
+    function(value, added);
+    return added;
+  }
+
+  // Calls |function|(Value* value) under the shard lock if |key| is
+  // present. Returns whether it was.
+  template <typename K, typename Function>
+  bool Update(const K& key, Function function) {
+    Shard& shard = ShardFor(key);
+    WriterMutexLock lock(&shard.mutex);
+    typename Map::iterator it = shard.map.find(key);
+    if (it == shard.map.end())
+      return false;
+    function(&it->second);
+    return true;
+  }
+
+  // Removes |key|. Returns whether it was present.
+  template <typename K>
+  bool Erase(const K& key) {
+    Shard& shard = ShardFor(key);
+    WriterMutexLock lock(&shard.mutex);
+    return shard.map.erase(key) != 0;
+  }
+
+  // Removes |key| if |predicate|(const Value&) holds, atomically. Returns
+  // whether it was removed.
+  template <typename K, typename Predicate>
+  bool EraseIf(const K& key, Predicate predicate) {
+    Shard& shard = ShardFor(key);
+    WriterMutexLock lock(&shard.mutex);
+    typename Map::iterator it = shard.map.find(key);
+    if (it == shard.map.end() || !predicate(it->second))
+      return false;
+    shard.map.erase(it);
+    return true;
+  }
+
+  void Clear() {
+    for (int i = 0; i < num_shards_; ++i) {
+      WriterMutexLock lock(&shards_[i].mutex);
+      shards_[i].map.clear();
+    }
+  }
+
+  // The number of keys, summed shard by shard; with concurrent writers it
+  // is only approximate.
+  size_t Size() const {
+    size_t size = 0;
+    for (int i = 0; i < num_shards_; ++i) {
+      ReaderMutexLock lock(&shards_[i].mutex);
+      size += shards_[i].map.size();
+    }
+    return size;
+  }
+
+  // Calls |function|(const Key&, const Value&) for each entry. Each shard is
+  // copied under its reader lock and visited after the lock is released, so
+  // writers wait for a copy at most, and |function| may call into the map.
+  // Every entry present for the whole call is visited once; entries added
+  // or removed meanwhile may or may not be.
+  template <typename Function>
+  void ForEach(Function function) const {
+    std::vector<std::pair<Key, Value> > entries;
+    for (int i = 0; i < num_shards_; ++i) {
+      entries.clear();
+      {
+        ReaderMutexLock lock(&shards_[i].mutex);
+        entries.assign(shards_[i].map.begin(), shards_[i].map.end());
+      }
+      for (size_t j = 0; j < entries.size(); ++j)
+        function(entries[j].first, entries[j].second);
+    }
+  }
+
+ private:
+  typedef flat_hash_map<Key, Value, Hash, Equal> Map;
+
+  struct Shard {
+    mutable RwMutex mutex;
+    Map map;
+    // Keeps the next shard's lock off this shard's cache lines, so threads
+    // on different shards do not slow each other down.
+    char padding[64];
+  };
+
+  // Picks the shard from the top bits of the hash; the map of the shard
+  // uses the low ones.
+  template <typename K>
+  Shard& ShardFor(const K& key) const {
+    if (num_shards_ == 1)
+      return shards_[0];
+    return shards_[static_cast<uint64>(Hash()(key)) >> shard_shift_];
+  }
+
+  int shard_shift_;
+  Shard* shards_;
+  int num_shards_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConcurrentHashMap);
+};
+
+}  // namespace base
+
+#endif  // PUBLIC_BASE_CONCURRENT_HASH_MAP_H_
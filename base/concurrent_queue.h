@@ -11,7 +11,7 @@ namespace base {
 template<class Data>
 class ConcurrentQueue {
  public:
-  ConcurrentQueue() {}
+  ConcurrentQueue() : condition_variable_(&mutex_) {}
   virtual ~ConcurrentQueue() {}
 
   virtual void Push(const Data& data) {
@@ -24,7 +24,7 @@ class ConcurrentQueue {
     base::MutexLock lock(&mutex_);
 
     while (queue_.empty()) {
-      condition_variable_.Wait(&mutex_);
+      condition_variable_.Wait();
     }
     data = queue_.front();
     queue_.pop();
@@ -67,13 +67,14 @@ class ConcurrentQueue {
 template<typename Data>
 class FixedSizeConQueue : public ConcurrentQueue<Data> {
  public:
-  explicit FixedSizeConQueue(int max_count = 256) : max_count_(max_count) {}
+  explicit FixedSizeConQueue(int max_count = 256)
+      : condition_full_(&this->mutex_), max_count_(max_count) {}
   virtual ~FixedSizeConQueue() {}
 
   virtual void Push(const Data& data) {
     base::MutexLock lock(&this->mutex_);
-    while (this->queue_.size() >= max_count_) {
-      condition_full_.Wait(&(this->mutex_));
+    while (static_cast<int>(this->queue_.size()) >= max_count_) {
+      condition_full_.Wait();
     }
     this->queue_.push(data);
     this->condition_variable_.Signal();
@@ -83,7 +84,7 @@ class FixedSizeConQueue : public ConcurrentQueue<Data> {
     base::MutexLock lock(&this->mutex_);
 
     while (this->queue_.empty()) {
-      this->condition_variable_.Wait(&this->mutex_);
+      this->condition_variable_.Wait();
     }
     data = this->queue_.front();
     this->queue_.pop();
@@ -92,7 +93,7 @@ class FixedSizeConQueue : public ConcurrentQueue<Data> {
 
   bool Full() const {
     base::MutexLock lock(&this->mutex_);
-    return this->queue_.size() >= max_count_;
+    return static_cast<int>(this->queue_.size()) >= max_count_;
   }
 
  private:
@@ -0,0 +1,255 @@
+#include "base/count_min_sketch.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#include "base/atomicops.h"
+#endif
+
+namespace {
+
+const char kCountMinMagic[4] = { 'C', 'M', 'S', '1' };
+const char kCountSketchMagic[4] = { 'C', 'S', 'K', '1' };
+
+const int kMaxDepth = 64;
+
+// Row |row| of a key uses counter (h1 + row * h2) mod width, for the two
+// halves of its fingerprint, h2 made odd so rows differ on a power of two
+// width (Kirsch and Mitzenmacher).
+class RowHasher {
+ public:
+  explicit RowHasher(uint64 fp)
+      : h1_(static_cast<uint32>(fp)),
+        h2_(static_cast<uint32>(fp >> 32) | 1) {}
+
+  uint32 Hash(int row) const { return h1_ + row * h2_; }
+
+ private:
+  const uint32 h1_;
+  const uint32 h2_;
+};
+
+int RoundUpToPowerOfTwo(int width) {
+  int rounded = 1;
+  while (rounded < width)
+    rounded *= 2;
+  return rounded;
+}
+
+// dst[i] += src[i] for the |n| counters; two's complement makes this right
+// for signed counters as well.
+void AddCountersScalar(uint64* dst, const uint64* src, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    dst[i] += src[i];
+}
+
+#if defined(__x86_64__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+void AddCountersAvx2(uint64* dst, const uint64* src, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i* d = reinterpret_cast<__m256i*>(dst + i);
+    const __m256i* s = reinterpret_cast<const __m256i*>(src + i);
+    _mm256_storeu_si256(d, _mm256_add_epi64(_mm256_loadu_si256(d),
+                                            _mm256_loadu_si256(s)));
+    _mm256_storeu_si256(d + 1, _mm256_add_epi64(_mm256_loadu_si256(d + 1),
+                                                _mm256_loadu_si256(s + 1)));
+  }
+  AddCountersScalar(dst + i, src + i, n - i);
+}
+
+#pragma GCC pop_options
+
+void AddCountersSse2(uint64* dst, const uint64* src, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i* d = reinterpret_cast<__m128i*>(dst + i);
+    const __m128i* s = reinterpret_cast<const __m128i*>(src + i);
+    _mm_storeu_si128(d, _mm_add_epi64(_mm_loadu_si128(d),
+                                      _mm_loadu_si128(s)));
+    _mm_storeu_si128(d + 1, _mm_add_epi64(_mm_loadu_si128(d + 1),
+                                          _mm_loadu_si128(s + 1)));
+  }
+  AddCountersScalar(dst + i, src + i, n - i);
+}
+#endif  // __x86_64__
+
+void AddCounters(uint64* dst, const uint64* src, size_t n) {
+#if defined(__x86_64__)
+  if (AtomicOps_Internalx86CPUFeatures.has_avx2)
+    AddCountersAvx2(dst, src, n);
+  else
+    AddCountersSse2(dst, src, n);
+#else
+  AddCountersScalar(dst, src, n);
+#endif
+}
+
+// Header of both sketches: magic, width, depth, then a uint64 of the
+// sketch and the counters.
+void AppendHeader(const char* magic, int width, int depth, uint64 extra,
+                  std::string* out) {
+  const uint32 dimensions[2] = { static_cast<uint32>(width),
+                                 static_cast<uint32>(depth) };
+  out->append(magic, 4);
+  out->append(reinterpret_cast<const char*>(dimensions), sizeof(dimensions));
+  out->append(reinterpret_cast<const char*>(&extra), sizeof(extra));
+}
+
+const size_t kHeaderSize = 4 + 2 * sizeof(uint32) + sizeof(uint64);
+
+// Checks the header and size of a serialized sketch and reads its fields.
+bool ParseHeader(const char* magic, const base::StringPiece& data, int* width,
+                 int* depth, uint64* extra) {
+  if (data.size() < kHeaderSize || memcmp(data.data(), magic, 4))
+    return false;
+  uint32 dimensions[2];
+  memcpy(dimensions, data.data() + 4, sizeof(dimensions));
+  memcpy(extra, data.data() + 4 + sizeof(dimensions), sizeof(*extra));
+  const uint64 num_counters =
+      static_cast<uint64>(dimensions[0]) * dimensions[1];
+  if (dimensions[0] == 0 || dimensions[0] > (1U << 30) ||
+      (dimensions[0] & (dimensions[0] - 1)) != 0 || dimensions[1] == 0 ||
+      dimensions[1] > static_cast<uint32>(kMaxDepth) ||
+      (data.size() - kHeaderSize) / sizeof(uint64) != num_counters ||
+      (data.size() - kHeaderSize) % sizeof(uint64) != 0) {
+    return false;
+  }
+  *width = dimensions[0];
+  *depth = dimensions[1];
+  return true;
+}
+
+}  // namespace
+
+namespace base {
+
+CountMinSketch::CountMinSketch(int width, int depth)
+    : width_(RoundUpToPowerOfTwo(width)), depth_(depth), total_(0) {
+  CHECK_GT(depth, 0);
+  CHECK_LE(depth, kMaxDepth);
+  counters_.resize(static_cast<size_t>(width_) * depth_);
+}
+
+void CountMinSketch::AddFingerprint(uint64 fp, uint64 count) {
+  const RowHasher hasher(fp);
+  uint64* row = &counters_[0];
+  for (int i = 0; i < depth_; ++i, row += width_)
+    row[hasher.Hash(i) & (width_ - 1)] += count;
+  total_ += count;
+}
+
+uint64 CountMinSketch::EstimateFingerprint(uint64 fp) const {
+  const RowHasher hasher(fp);
+  const uint64* row = &counters_[0];
+  uint64 estimate = kuint64max;
+  for (int i = 0; i < depth_; ++i, row += width_)
+    estimate = std::min(estimate, row[hasher.Hash(i) & (width_ - 1)]);
+  return estimate;
+}
+
+bool CountMinSketch::Merge(const CountMinSketch& other) {
+  if (other.width_ != width_ || other.depth_ != depth_)
+    return false;
+  AddCounters(&counters_[0], &other.counters_[0], counters_.size());
+  total_ += other.total_;
+  return true;
+}
+
+void CountMinSketch::Clear() {
+  std::fill(counters_.begin(), counters_.end(), 0);
+  total_ = 0;
+}
+
+void CountMinSketch::SerializeTo(std::string* out) const {
+  AppendHeader(kCountMinMagic, width_, depth_, total_, out);
+  out->append(reinterpret_cast<const char*>(&counters_[0]),
+              counters_.size() * sizeof(uint64));
+}
+
+bool CountMinSketch::Deserialize(const StringPiece& data) {
+  int width, depth;
+  uint64 total;
+  if (!ParseHeader(kCountMinMagic, data, &width, &depth, &total))
+    return false;
+  std::vector<uint64> counters(static_cast<size_t>(width) * depth);
+  memcpy(&counters[0], data.data() + kHeaderSize,
+         counters.size() * sizeof(uint64));
+  width_ = width;
+  depth_ = depth;
+  total_ = total;
+  counters_.swap(counters);
+  return true;
+}
+
+CountSketch::CountSketch(int width, int depth)
+    : width_(RoundUpToPowerOfTwo(width)), depth_(depth) {
+  CHECK_GT(depth, 0);
+  CHECK_LE(depth, kMaxDepth);
+  counters_.resize(static_cast<size_t>(width_) * depth_);
+}
+
+void CountSketch::AddFingerprint(uint64 fp, int64 count) {
+  const RowHasher hasher(fp);
+  int64* row = &counters_[0];
+  for (int i = 0; i < depth_; ++i, row += width_) {
+    // The index takes the low bits of the row hash, the sign the top one.
+    const uint32 hash = hasher.Hash(i);
+    row[hash & (width_ - 1)] += (hash >> 31) ? -count : count;
+  }
+}
+
+int64 CountSketch::EstimateFingerprint(uint64 fp) const {
+  const RowHasher hasher(fp);
+  const int64* row = &counters_[0];
+  int64 estimates[kMaxDepth];
+  for (int i = 0; i < depth_; ++i, row += width_) {
+    const uint32 hash = hasher.Hash(i);
+    const int64 counter = row[hash & (width_ - 1)];
+    estimates[i] = (hash >> 31) ? -counter : counter;
+  }
+  std::nth_element(estimates, estimates + depth_ / 2, estimates + depth_);
+  return estimates[depth_ / 2];
+}
+
+bool CountSketch::Merge(const CountSketch& other) {
+  if (other.width_ != width_ || other.depth_ != depth_)
+    return false;
+  AddCounters(reinterpret_cast<uint64*>(&counters_[0]),
+              reinterpret_cast<const uint64*>(&other.counters_[0]),
+              counters_.size());
+  return true;
+}
+
+void CountSketch::Clear() {
+  std::fill(counters_.begin(), counters_.end(), 0);
+}
+
+void CountSketch::SerializeTo(std::string* out) const {
+  AppendHeader(kCountSketchMagic, width_, depth_, 0, out);
+  out->append(reinterpret_cast<const char*>(&counters_[0]),
+              counters_.size() * sizeof(int64));
+}
+
+bool CountSketch::Deserialize(const StringPiece& data) {
+  int width, depth;
+  uint64 unused;
+  if (!ParseHeader(kCountSketchMagic, data, &width, &depth, &unused))
+    return false;
+  std::vector<int64> counters(static_cast<size_t>(width) * depth);
+  memcpy(&counters[0], data.data() + kHeaderSize,
+         counters.size() * sizeof(int64));
+  width_ = width;
+  depth_ = depth;
+  counters_.swap(counters);
+  return true;
+}
+
+}  // namespace base
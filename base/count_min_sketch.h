@@ -0,0 +1,114 @@
+// Description : Frequency sketches: approximate counts of the keys of a
+//               stream in a fixed table of counters, |depth| rows of |width|.
+//               A key adds to one counter per row, picked by its
+//               fingerprint.
+//
+//               CountMinSketch estimates a count as the smallest of its
+//               counters. The estimate is never below the true count, and
+//               exceeds it by more than 2 * total / width with probability
+//               at most 2^-depth, which suits finding heavy hitters.
+//               CountSketch also adds or subtracts each key, by a sign taken
+//               from the fingerprint, and estimates with the median of the
+//               signed counters, which is unbiased, and whose error depends
+//               on how skewed the stream is rather than on its total.
+//
+//               Sketches of the same dimensions merge into the sketch of the
+//               combined streams, so shards can count separately, serialize,
+//               and be combined anywhere.
+//
+// Usage:
+//   base::CountMinSketch hits(1 << 16, 4);
+//   hits.Add(url);
+//   ...
+//   if (hits.Estimate(url) > threshold) ...
+
+#ifndef PUBLIC_BASE_COUNT_MIN_SKETCH_H_
+#define PUBLIC_BASE_COUNT_MIN_SKETCH_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/hash.h"
+#include "base/string_piece.h"
+
+namespace base {
+
+class CountMinSketch {
+ public:
+  // |width| is rounded up to a power of two. |depth| is at most 64.
+  CountMinSketch(int width, int depth);
+
+  // Keys are hashed with Fingerprint(); the *Fingerprint() versions take a
+  // fingerprint computed by the caller.
+  void Add(const StringPiece& key, uint64 count = 1) {
+    AddFingerprint(Fingerprint(key), count);
+  }
+  void AddFingerprint(uint64 fp, uint64 count = 1);
+
+  uint64 Estimate(const StringPiece& key) const {
+    return EstimateFingerprint(Fingerprint(key));
+  }
+  uint64 EstimateFingerprint(uint64 fp) const;
+
+  // Adds the counts of |other|, which must have the same dimensions.
+  // Returns false, changing nothing, if it has not.
+  bool Merge(const CountMinSketch& other);
+
+  void Clear();
+
+  int width() const { return width_; }
+  int depth() const { return depth_; }
+  // The sum of all counts added.
+  uint64 total() const { return total_; }
+
+  // Appends the sketch to |out|, to be read back by Deserialize() on a
+  // machine of the same byte order.
+  void SerializeTo(std::string* out) const;
+
+  // Replaces the sketch with one written by SerializeTo(). Returns false,
+  // leaving the sketch unchanged, if |data| is not such a sketch.
+  bool Deserialize(const StringPiece& data);
+
+ private:
+  int width_;
+  int depth_;
+  uint64 total_;
+  std::vector<uint64> counters_;  // Row after row.
+};
+
+class CountSketch {
+ public:
+  // |width| is rounded up to a power of two. An odd |depth| gives a true
+  // median.
+  CountSketch(int width, int depth);
+
+  void Add(const StringPiece& key, int64 count = 1) {
+    AddFingerprint(Fingerprint(key), count);
+  }
+  void AddFingerprint(uint64 fp, int64 count = 1);
+
+  int64 Estimate(const StringPiece& key) const {
+    return EstimateFingerprint(Fingerprint(key));
+  }
+  int64 EstimateFingerprint(uint64 fp) const;
+
+  bool Merge(const CountSketch& other);
+
+  void Clear();
+
+  int width() const { return width_; }
+  int depth() const { return depth_; }
+
+  void SerializeTo(std::string* out) const;
+  bool Deserialize(const StringPiece& data);
+
+ private:
+  int width_;
+  int depth_;
+  std::vector<int64> counters_;
+};
+
+}  // namespace base
+
+#endif  // PUBLIC_BASE_COUNT_MIN_SKETCH_H_
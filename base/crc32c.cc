@@ -0,0 +1,194 @@
+#include "base/crc32c.h"
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#include "base/atomicops.h"
+#endif
+
+namespace {
+
+// The CRC32C polynomial, bit reversed.
+const uint32 kPolynomial = 0x82f63b78;
+
+// The hardware path checksums three streams at once to hide the latency of
+// the crc32 instruction, first in long blocks, then in short ones, and
+// joins them by shifting the CRC of each stream over the following ones.
+const size_t kLongBlock = 8192;
+const size_t kShortBlock = 256;
+
+// Returns a * b modulo the polynomial, both bit reversed: bit 31 is x^0.
+uint32 MultiplyModP(uint32 a, uint32 b) {
+  uint32 m = static_cast<uint32>(1) << 31;
+  uint32 p = 0;
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0)
+        break;
+    }
+    m >>= 1;
+    b = b & 1 ? (b >> 1) ^ kPolynomial : b >> 1;
+  }
+  return p;
+}
+
+// Returns x^(8 * len) modulo the polynomial, by squaring.
+uint32 XPow8N(uint64 len) {
+  uint32 power = static_cast<uint32>(1) << 30;  // x^1
+  for (int i = 0; i < 3; ++i)
+    power = MultiplyModP(power, power);         // x^8
+  uint32 result = static_cast<uint32>(1) << 31;  // x^0
+  while (len) {
+    if (len & 1)
+      result = MultiplyModP(power, result);
+    len >>= 1;
+    power = MultiplyModP(power, power);
+  }
+  return result;
+}
+
+struct Crc32cTables {
+  // Slicing-by-8: slice[k][b] is the CRC register after byte b followed by
+  // k zero bytes.
+  uint32 slice[8][256];
+  // shift_long[k][b] is byte k of a CRC register, set to b, shifted over
+  // kLongBlock zero bytes; likewise shift_short.
+  uint32 shift_long[4][256];
+  uint32 shift_short[4][256];
+};
+
+void InitShiftTable(uint64 len, uint32 table[4][256]) {
+  const uint32 power = XPow8N(len);
+  for (int k = 0; k < 4; ++k) {
+    for (uint32 b = 0; b < 256; ++b)
+      table[k][b] = MultiplyModP(power, b << (8 * k));
+  }
+}
+
+const Crc32cTables* NewTables() {
+  Crc32cTables* tables = new Crc32cTables;
+  for (uint32 b = 0; b < 256; ++b) {
+    uint32 crc = b;
+    for (int bit = 0; bit < 8; ++bit)
+      crc = crc & 1 ? (crc >> 1) ^ kPolynomial : crc >> 1;
+    tables->slice[0][b] = crc;
+  }
+  for (uint32 b = 0; b < 256; ++b) {
+    uint32 crc = tables->slice[0][b];
+    for (int k = 1; k < 8; ++k) {
+      crc = tables->slice[0][crc & 0xff] ^ (crc >> 8);
+      tables->slice[k][b] = crc;
+    }
+  }
+  InitShiftTable(kLongBlock, tables->shift_long);
+  InitShiftTable(kShortBlock, tables->shift_short);
+  return tables;
+}
+
+// Built on first use, so checksums work from static initializers.
+const Crc32cTables& Tables() {
+  static const Crc32cTables* tables = NewTables();
+  return *tables;
+}
+
+inline uint64 Load64(const uint8* p) {
+  uint64 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32 Shift(const uint32 table[4][256], uint32 crc) {
+  return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^
+         table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+uint32 ExtendSoftware(uint32 crc, const uint8* p, size_t len) {
+  const Crc32cTables& tables = Tables();
+  const uint32 (*slice)[256] = tables.slice;
+  for (; len > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0; --len)
+    crc = slice[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  for (; len >= 8; len -= 8, p += 8) {
+    const uint64 word = Load64(p) ^ crc;
+    crc = slice[7][word & 0xff] ^
+          slice[6][(word >> 8) & 0xff] ^
+          slice[5][(word >> 16) & 0xff] ^
+          slice[4][(word >> 24) & 0xff] ^
+          slice[3][(word >> 32) & 0xff] ^
+          slice[2][(word >> 40) & 0xff] ^
+          slice[1][(word >> 48) & 0xff] ^
+          slice[0][word >> 56];
+  }
+  for (; len > 0; --len)
+    crc = slice[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__)
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+
+// Runs three streams of |block| bytes over |*p| while at least three blocks
+// remain, joining them into |crc|.
+inline uint64 ExtendThreeStreams(uint64 crc, const uint8** p, size_t* len,
+                                 size_t block,
+                                 const uint32 shift[4][256]) {
+  while (*len >= 3 * block) {
+    const uint8* p0 = *p;
+    const uint8* const end = p0 + block;
+    uint64 crc1 = 0;
+    uint64 crc2 = 0;
+    for (; p0 < end; p0 += 8) {
+      crc = _mm_crc32_u64(crc, Load64(p0));
+      crc1 = _mm_crc32_u64(crc1, Load64(p0 + block));
+      crc2 = _mm_crc32_u64(crc2, Load64(p0 + 2 * block));
+    }
+    crc = Shift(shift, static_cast<uint32>(crc)) ^ crc1;
+    crc = Shift(shift, static_cast<uint32>(crc)) ^ crc2;
+    *p += 3 * block;
+    *len -= 3 * block;
+  }
+  return crc;
+}
+
+uint32 ExtendHardware(uint32 crc32, const uint8* p, size_t len) {
+  uint64 crc = crc32;
+  for (; len > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0; --len)
+    crc = _mm_crc32_u8(static_cast<uint32>(crc), *p++);
+  if (len >= 3 * kShortBlock) {
+    const Crc32cTables& tables = Tables();
+    crc = ExtendThreeStreams(crc, &p, &len, kLongBlock, tables.shift_long);
+    crc = ExtendThreeStreams(crc, &p, &len, kShortBlock, tables.shift_short);
+  }
+  for (; len >= 8; len -= 8, p += 8)
+    crc = _mm_crc32_u64(crc, Load64(p));
+  for (; len > 0; --len)
+    crc = _mm_crc32_u8(static_cast<uint32>(crc), *p++);
+  return static_cast<uint32>(crc);
+}
+
+#pragma GCC pop_options
+#endif  // __x86_64__
+
+}  // namespace
+
+namespace base {
+
+uint32 Crc32cExtend(uint32 crc, const void* data, size_t len) {
+  const uint8* p = static_cast<const uint8*>(data);
+  crc = ~crc;
+#if defined(__x86_64__)
+  // Checked on every call: the flag is set by a static initializer that may
+  // not have run yet.
+  if (AtomicOps_Internalx86CPUFeatures.has_sse42)
+    return ~ExtendHardware(crc, p, len);
+#endif
+  return ~ExtendSoftware(crc, p, len);
+}
+
+uint32 Crc32cCombine(uint32 crc1, uint32 crc2, uint64 len2) {
+  return MultiplyModP(XPow8N(len2), crc1) ^ crc2;
+}
+
+}  // namespace base
@@ -0,0 +1,38 @@
+// Description : CRC32C (Castagnoli) checksums for verifying data blocks, as
+//               used by iSCSI, ext4 and LevelDB. Runs on the SSE4.2 crc32
+//               instruction when the processor has it, and on a
+//               slicing-by-8 table otherwise; both give the same values.
+//
+// Usage:
+//   uint32 crc = base::Crc32c(block, len);
+//
+//   // Checksum chunks in parallel, then join them in order.
+//   uint32 crc = base::Crc32c(first, first_len);
+//   crc = base::Crc32cCombine(crc, base::Crc32c(second, second_len),
+//                             second_len);
+
+#ifndef PUBLIC_BASE_CRC32C_H_
+#define PUBLIC_BASE_CRC32C_H_
+
+#include <stddef.h>
+
+#include "base/basictypes.h"
+
+namespace base {
+
+// Returns the CRC32C of |len| bytes at |data|, after extending the CRC32C
+// |crc| of some preceding data: Crc32cExtend(Crc32c(a), b) is Crc32c(a + b).
+uint32 Crc32cExtend(uint32 crc, const void* data, size_t len);
+
+// Returns the CRC32C of |len| bytes at |data|.
+inline uint32 Crc32c(const void* data, size_t len) {
+  return Crc32cExtend(0, data, len);
+}
+
+// Returns the CRC32C of the concatenation of two pieces of data given
+// their CRC32Cs and the length of the second one. Takes O(log len2).
+uint32 Crc32cCombine(uint32 crc1, uint32 crc2, uint64 len2);
+
+}  // namespace base
+
+#endif  // PUBLIC_BASE_CRC32C_H_
@@ -0,0 +1,215 @@
+#include "base/cuckoo_filter.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+
+const uint64 kLowBits = 0x0001000100010001ULL;
+const uint64 kHighBits = 0x8000800080008000ULL;
+
+// Bounds the search for a free slot; past it the filter counts as full.
+const int kMaxPathLength = 500;
+
+const char kMagic[4] = { 'C', 'K', 'F', '1' };
+
+// The high bit of each 16-bit lane of |word| that is zero, and possibly of
+// some lanes above it; the lowest bit set is always exact.
+inline uint64 ZeroLanes(uint64 word) {
+  return (word - kLowBits) & ~word & kHighBits;
+}
+
+// The slot of |word| holding |tag|, the lowest if several do, or -1.
+inline int FindTag(uint64 word, uint32 tag) {
+  const uint64 lanes = ZeroLanes(word ^ (tag * kLowBits));
+  return lanes ? __builtin_ctzll(lanes) >> 4 : -1;
+}
+
+// The tag stored for a fingerprint: its low 16 bits, never zero, which
+// marks a free slot.
+inline uint32 TagOf(uint64 fp) {
+  const uint32 tag = static_cast<uint32>(fp) & 0xffff;
+  return tag ? tag : 1;
+}
+
+inline uint32 TagAt(uint64 word, int slot) {
+  return static_cast<uint32>(word >> (slot * 16)) & 0xffff;
+}
+
+}  // namespace
+
+namespace base {
+
+CuckooFilter::CuckooFilter(uint64 expected_keys)
+    : mask_(0), size_(0), version_(0), random_(2463534242U) {
+  // Four tags per bucket at 95% occupancy.
+  const uint64 wanted = (expected_keys * 100 + 379) / 380;
+  uint64 num_buckets = 2;
+  while (num_buckets < wanted)
+    num_buckets *= 2;
+  buckets_.resize(num_buckets);
+  mask_ = num_buckets - 1;
+}
+
+uint64 CuckooFilter::AltIndex(uint64 index, uint32 tag) const {
+  // Depends on the tag alone, so the other bucket of a tag can be found
+  // from either bucket without the key.
+  return (index ^ ((tag * 0xc6a4a7935bd1e995ULL) >> 32)) & mask_;
+}
+
+void CuckooFilter::SetSlot(uint64 index, int slot, uint32 tag) {
+  const uint64 word =
+      (buckets_[index] & ~(static_cast<uint64>(0xffff) << (slot * 16))) |
+      (static_cast<uint64>(tag) << (slot * 16));
+  __atomic_store_n(&buckets_[index], word, __ATOMIC_RELAXED);
+}
+
+bool CuckooFilter::AddToBucket(uint64 index, uint32 tag) {
+  const int slot = FindTag(LoadBucket(index), 0);
+  if (slot < 0)
+    return false;
+  SetSlot(index, slot, tag);
+  return true;
+}
+
+uint32 CuckooFilter::NextRandom() {
+  random_ ^= random_ << 13;
+  random_ ^= random_ >> 17;
+  random_ ^= random_ << 5;
+  return random_;
+}
+
+bool CuckooFilter::FindPath(uint64 index, std::vector<Move>* path) {
+  path->clear();
+  uint64 bucket = index;
+  for (int step = 0; step < kMaxPathLength; ++step) {
+    // Pick a random slot not already on the path, so that no tag is asked
+    // to move twice.
+    const int first = NextRandom() & 3;
+    int slot = -1;
+    for (int i = 0; i < 4 && slot < 0; ++i) {
+      const int candidate = (first + i) & 3;
+      size_t j = 0;
+      while (j < path->size() &&
+             ((*path)[j].bucket != bucket || (*path)[j].slot != candidate)) {
+        ++j;
+      }
+      if (j == path->size())
+        slot = candidate;
+    }
+    if (slot < 0)
+      return false;
+    const Move move = { bucket, slot };
+    path->push_back(move);
+    bucket = AltIndex(bucket, TagAt(LoadBucket(bucket), slot));
+    if (FindTag(LoadBucket(bucket), 0) >= 0)
+      return true;
+  }
+  return false;
+}
+
+bool CuckooFilter::InsertFingerprint(uint64 fp) {
+  const uint32 tag = TagOf(fp);
+  const uint64 index = Index(fp);
+  const uint64 alt_index = AltIndex(index, tag);
+  if (!AddToBucket(index, tag) && !AddToBucket(alt_index, tag)) {
+    std::vector<Move> path;
+    if (!FindPath(NextRandom() & 1 ? index : alt_index, &path))
+      return false;
+
+    // Moves the tags from the end of the path, each into the slot its
+    // successor left, so none is ever missing from both its buckets; the
+    // version still tells lookups to retry, since they read the two
+    // buckets one after the other.
+    __atomic_store_n(&version_, version_ + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    const Move& last = path.back();
+    uint64 to_bucket = AltIndex(last.bucket,
+                                TagAt(buckets_[last.bucket], last.slot));
+    int to_slot = FindTag(buckets_[to_bucket], 0);
+    for (size_t i = path.size(); i-- > 0;) {
+      const Move& move = path[i];
+      SetSlot(to_bucket, to_slot, TagAt(buckets_[move.bucket], move.slot));
+      SetSlot(move.bucket, move.slot, 0);
+      to_bucket = move.bucket;
+      to_slot = move.slot;
+    }
+    SetSlot(to_bucket, to_slot, tag);
+    __atomic_store_n(&version_, version_ + 1, __ATOMIC_RELEASE);
+  }
+  __atomic_store_n(&size_, size_ + 1, __ATOMIC_RELAXED);
+  return true;
+}
+
+bool CuckooFilter::EraseFingerprint(uint64 fp) {
+  const uint32 tag = TagOf(fp);
+  uint64 index = Index(fp);
+  int slot = FindTag(buckets_[index], tag);
+  if (slot < 0) {
+    index = AltIndex(index, tag);
+    slot = FindTag(buckets_[index], tag);
+    if (slot < 0)
+      return false;
+  }
+  SetSlot(index, slot, 0);
+  __atomic_store_n(&size_, size_ - 1, __ATOMIC_RELAXED);
+  return true;
+}
+
+bool CuckooFilter::MayContainFingerprint(uint64 fp) const {
+  const uint32 tag = TagOf(fp);
+  const uint64 index = Index(fp);
+  const uint64 alt_index = AltIndex(index, tag);
+  for (;;) {
+    const uint32 version = __atomic_load_n(&version_, __ATOMIC_ACQUIRE);
+    if (FindTag(LoadBucket(index), tag) >= 0 ||
+        FindTag(LoadBucket(alt_index), tag) >= 0) {
+      return true;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if ((version & 1) == 0 &&
+        __atomic_load_n(&version_, __ATOMIC_RELAXED) == version) {
+      return false;
+    }
+  }
+}
+
+void CuckooFilter::Clear() {
+  std::fill(buckets_.begin(), buckets_.end(), 0);
+  size_ = 0;
+}
+
+void CuckooFilter::SerializeTo(std::string* out) const {
+  const uint64 num_buckets = buckets_.size();
+  out->append(kMagic, sizeof(kMagic));
+  out->append(reinterpret_cast<const char*>(&num_buckets),
+              sizeof(num_buckets));
+  out->append(reinterpret_cast<const char*>(&size_), sizeof(size_));
+  out->append(reinterpret_cast<const char*>(&buckets_[0]),
+              num_buckets * sizeof(uint64));
+}
+
+bool CuckooFilter::Deserialize(const StringPiece& data) {
+  const size_t header = sizeof(kMagic) + 2 * sizeof(uint64);
+  if (data.size() < header || memcmp(data.data(), kMagic, sizeof(kMagic)))
+    return false;
+  uint64 num_buckets, size;
+  memcpy(&num_buckets, data.data() + sizeof(kMagic), sizeof(num_buckets));
+  memcpy(&size, data.data() + sizeof(kMagic) + sizeof(num_buckets),
+         sizeof(size));
+  if (num_buckets < 2 || (num_buckets & (num_buckets - 1)) != 0 ||
+      (data.size() - header) / sizeof(uint64) != num_buckets ||
+      (data.size() - header) % sizeof(uint64) != 0 ||
+      size > num_buckets * 4) {
+    return false;
+  }
+  std::vector<uint64> buckets(num_buckets);
+  memcpy(&buckets[0], data.data() + header, num_buckets * sizeof(uint64));
+  buckets_.swap(buckets);
+  mask_ = num_buckets - 1;
+  size_ = size;
+  return true;
+}
+
+}  // namespace base
@@ -0,0 +1,125 @@
+// Description : Cuckoo filter: an approximate set like a Bloom filter that
+//               also supports deletion. A key is stored as a 16-bit tag, in
+//               one of two buckets of four tags each, and a lookup reads
+//               both buckets, one 64-bit word apiece. With 16-bit tags
+//               about 0.01% of absent keys are reported present, at up to
+//               95% occupancy.
+//
+//               Lookups may run concurrently with one writer. For several
+//               writers use ConcurrentInsert() and ConcurrentErase(), which
+//               take a lock among themselves.
+//
+// Usage:
+//   base::CuckooFilter filter(num_keys);
+//   filter.Insert(key);
+//   if (filter.MayContain(key)) ...
+//   filter.Erase(key);
+
+#ifndef PUBLIC_BASE_CUCKOO_FILTER_H_
+#define PUBLIC_BASE_CUCKOO_FILTER_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/hash.h"
+#include "base/mutex.h"
+#include "base/string_piece.h"
+
+namespace base {
+
+class CuckooFilter {
+ public:
+  // Sizes the filter to hold |expected_keys|.
+  explicit CuckooFilter(uint64 expected_keys);
+
+  // Keys are hashed with Fingerprint(); the *Fingerprint() versions take a
+  // fingerprint computed by the caller.
+
+  // Adds a copy of the tag of |key|, even if one is present. Returns false,
+  // leaving the filter unchanged, if the filter is full.
+  bool Insert(const StringPiece& key) {
+    return InsertFingerprint(Fingerprint(key));
+  }
+  bool InsertFingerprint(uint64 fp);
+
+  // Removes one copy of the tag of |key|, which must have been inserted:
+  // erasing a key that was not may remove another key that shares its tag.
+  // Returns false if no tag was found.
+  bool Erase(const StringPiece& key) {
+    return EraseFingerprint(Fingerprint(key));
+  }
+  bool EraseFingerprint(uint64 fp);
+
+  // False if the key is not in the filter; true if it is, and for a small
+  // fraction of the other keys.
+  bool MayContain(const StringPiece& key) const {
+    return MayContainFingerprint(Fingerprint(key));
+  }
+  bool MayContainFingerprint(uint64 fp) const;
+
+  bool ConcurrentInsert(const StringPiece& key) {
+    const uint64 fp = Fingerprint(key);
+    MutexLock lock(&writer_mutex_);
+    return InsertFingerprint(fp);
+  }
+  bool ConcurrentErase(const StringPiece& key) {
+    const uint64 fp = Fingerprint(key);
+    MutexLock lock(&writer_mutex_);
+    return EraseFingerprint(fp);
+  }
+
+  void Clear();
+
+  // The number of tags stored.
+  uint64 size() const { return __atomic_load_n(&size_, __ATOMIC_RELAXED); }
+  uint64 num_buckets() const { return buckets_.size(); }
+  size_t size_in_bytes() const { return buckets_.size() * sizeof(uint64); }
+
+  // Appends the filter to |out|, to be read back by Deserialize() on a
+  // machine of the same byte order.
+  void SerializeTo(std::string* out) const;
+
+  // Replaces the filter with one written by SerializeTo(). Returns false,
+  // leaving the filter unchanged, if |data| is not such a filter. Must not
+  // run concurrently with any other call.
+  bool Deserialize(const StringPiece& data);
+
+ private:
+  // One step of a path of relocations: the tag in |slot| of |bucket|
+  // moves to its other bucket.
+  struct Move {
+    uint64 bucket;
+    int slot;
+  };
+
+  uint64 Index(uint64 fp) const { return (fp >> 32) & mask_; }
+  uint64 AltIndex(uint64 index, uint32 tag) const;
+
+  uint64 LoadBucket(uint64 index) const {
+    return __atomic_load_n(&buckets_[index], __ATOMIC_RELAXED);
+  }
+  void SetSlot(uint64 index, int slot, uint32 tag);
+  bool AddToBucket(uint64 index, uint32 tag);
+
+  // Looks for a path of at most kMaxPathLength relocations from |index|
+  // that ends in a free slot, and fills |path|.
+  bool FindPath(uint64 index, std::vector<Move>* path);
+
+  uint32 NextRandom();
+
+  std::vector<uint64> buckets_;  // Four 16-bit tags each; zero is free.
+  uint64 mask_;
+  uint64 size_;
+  // Odd while tags are being relocated; lookups that miss retry if it
+  // changed under them.
+  uint32 version_;
+  uint32 random_;
+  Mutex writer_mutex_;
+
+  DISALLOW_COPY_AND_ASSIGN(CuckooFilter);
+};
+
+}  // namespace base
+
+#endif  // PUBLIC_BASE_CUCKOO_FILTER_H_
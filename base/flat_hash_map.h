@@ -0,0 +1,639 @@
+// Description : Open addressing hash map and set in the style of SwissTable.
+//               Elements live in one flat array, next to an array of control
+//               bytes that holds 7 bits of each element's hash. A lookup
+//               compares the control bytes of 16 slots at once with SSE2 and
+//               touches an element only when those bits match, so it rarely
+//               costs more than one or two cache misses; there is no
+//               allocation per element.
+//
+//               base::flat_hash_map and base::flat_hash_set take the same
+//               template arguments as base::hash_map and base::hash_set and
+//               provide the commonly used part of their interface. Unlike
+//               theirs, iterators and references to elements are
+//               invalidated by any insertion that grows the table.
+//
+//               find(), count() and erase() accept any type the hash and
+//               equality functors accept; with the default functors a map
+//               keyed by std::string is looked up by StringPiece without
+//               building a string.
+//
+// Usage:
+//   base::flat_hash_map<std::string, int> counts;
+//   ++counts["apple"];
+//   base::flat_hash_map<std::string, int>::iterator it =
+//       counts.find(base::StringPiece(data, len));
+
+#ifndef PUBLIC_BASE_FLAT_HASH_MAP_H_
+#define PUBLIC_BASE_FLAT_HASH_MAP_H_
+
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "base/basictypes.h"
+#include "base/hash.h"
+#include "base/hash_tables.h"
+#include "base/string_piece.h"
+
+namespace base {
+
+namespace internal {
+
+// Spreads the bits of |value| over the whole word: the table uses both the
+// low bits and the high bits of the hash.
+inline size_t FlatHashMix(uint64 value) {
+  const unsigned __int128 product =
+      static_cast<unsigned __int128>(value) * 0x9E3779B97F4A7C15ULL;
+  return static_cast<size_t>(static_cast<uint64>(product) ^
+                             static_cast<uint64>(product >> 64));
+}
+
+struct FlatStringHash {
+  size_t operator()(const StringPiece& str) const {
+    return XXH3Hash64(str.data(), str.size(), 0);
+  }
+};
+
+}  // namespace internal
+
+// The default hash functor of the flat containers. Integers are mixed with a
+// multiply, strings hashed with XXH3; other types use the __gnu_cxx::hash
+// specialization that base::hash_map would use, mixed the same way.
+template <typename T>
+struct FlatHash {
+  size_t operator()(const T& value) const {
+    return internal::FlatHashMix(__gnu_cxx::hash<T>()(value));
+  }
+};
+
+#define DEFINE_FLAT_INTEGER_HASH(integral_type)                  \
+  template <>                                                    \
+  struct FlatHash<integral_type> {                               \
+    size_t operator()(integral_type value) const {               \
+      return internal::FlatHashMix(static_cast<uint64>(value));  \
+    }                                                            \
+  }
+
+DEFINE_FLAT_INTEGER_HASH(bool);
+DEFINE_FLAT_INTEGER_HASH(char);
+DEFINE_FLAT_INTEGER_HASH(signed char);
+DEFINE_FLAT_INTEGER_HASH(unsigned char);
+DEFINE_FLAT_INTEGER_HASH(short);
+DEFINE_FLAT_INTEGER_HASH(unsigned short);
+DEFINE_FLAT_INTEGER_HASH(int);
+DEFINE_FLAT_INTEGER_HASH(unsigned int);
+DEFINE_FLAT_INTEGER_HASH(long);
+DEFINE_FLAT_INTEGER_HASH(unsigned long);
+DEFINE_FLAT_INTEGER_HASH(long long);
+DEFINE_FLAT_INTEGER_HASH(unsigned long long);
+
+#undef DEFINE_FLAT_INTEGER_HASH
+
+template <>
+struct FlatHash<std::string> : internal::FlatStringHash {};
+
+template <>
+struct FlatHash<StringPiece> : internal::FlatStringHash {};
+
+// The default equality functor of the flat containers. Compares any two
+// types that have an operator==, so lookups by a different type work.
+template <typename T>
+struct FlatEqual {
+  template <typename A, typename B>
+  bool operator()(const A& a, const B& b) const {
+    return a == b;
+  }
+};
+
+namespace internal {
+
+// Control byte values. A full slot holds the low 7 bits of its hash.
+const int8 kFlatEmpty = -128;
+const int8 kFlatDeleted = -2;
+
+// Control bytes are scanned in groups of this many.
+const size_t kFlatGroupWidth = 16;
+
+// Bit i of the returned mask is set if control byte i of the group at
+// |ctrl| equals |h2|.
+inline uint32 FlatMatch(const int8* ctrl, int8 h2) {
+#if defined(__SSE2__)
+  const __m128i group =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h2)));
+#else
+  uint32 mask = 0;
+  for (size_t i = 0; i < kFlatGroupWidth; ++i)
+    mask |= static_cast<uint32>(ctrl[i] == h2) << i;
+  return mask;
+#endif
+}
+
+// Bit i is set if slot i of the group is empty or deleted, the two
+// negative control values.
+inline uint32 FlatMatchEmptyOrDeleted(const int8* ctrl) {
+#if defined(__SSE2__)
+  return _mm_movemask_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)));
+#else
+  uint32 mask = 0;
+  for (size_t i = 0; i < kFlatGroupWidth; ++i)
+    mask |= static_cast<uint32>(ctrl[i] < 0) << i;
+  return mask;
+#endif
+}
+
+// The table behind flat_hash_map and flat_hash_set. |Policy| gives the key
+// of a value, Policy::GetKey(value), and moves a value to uninitialized
+// storage, Policy::Transfer(dst, src), destroying the source.
+//
+// The capacity is 0 or a power of two of at least 16. Control bytes
+// [capacity, capacity + 16) mirror the first 16, so a group can be loaded
+// at any slot without wrapping. Probing visits groups at triangular offsets
+// from the slot picked by the hash, which reaches every slot.
+template <typename Value, typename Policy, typename Hash, typename Equal>
+class FlatHashTable {
+ public:
+  typedef Value value_type;
+  typedef Hash hasher;
+  typedef Equal key_equal;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <bool kConst>
+  class Iterator {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename FlatHashTable::value_type value_type;
+    typedef ptrdiff_t difference_type;
+    typedef typename FlatHashTable::value_type ValueType;
+    typedef typename std::conditional<kConst, const ValueType,
+                                      ValueType>::type Element;
+    typedef Element* pointer;
+    typedef Element& reference;
+
+    Iterator() : table_(NULL), index_(0) {}
+    // An iterator converts to a const_iterator.
+    Iterator(const Iterator<false>& other)
+        : table_(other.table_), index_(other.index_) {}
+
+    reference operator*() const { return table_->slots_[index_]; }
+    pointer operator->() const { return &table_->slots_[index_]; }
+
+    Iterator& operator++() {
+      index_ = table_->NextFull(index_ + 1);
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    bool operator==(const Iterator& other) const {
+      return index_ == other.index_;
+    }
+    bool operator!=(const Iterator& other) const {
+      return index_ != other.index_;
+    }
+
+   private:
+    friend class FlatHashTable;
+    template <bool> friend class Iterator;
+
+    typedef typename std::conditional<kConst, const FlatHashTable,
+                                      FlatHashTable>::type Table;
+
+    Iterator(Table* table, size_t index) : table_(table), index_(index) {}
+
+    Table* table_;
+    size_t index_;
+  };
+
+  typedef Iterator<false> iterator;
+  typedef Iterator<true> const_iterator;
+
+  explicit FlatHashTable(size_t bucket_count = 0,
+                         const Hash& hash = Hash(),
+                         const Equal& equal = Equal())
+      : ctrl_(NULL), slots_(NULL), capacity_(0), size_(0), growth_left_(0),
+        hash_(hash), equal_(equal) {
+    reserve(bucket_count);
+  }
+
+  FlatHashTable(const FlatHashTable& other)
+      : ctrl_(NULL), slots_(NULL), capacity_(0), size_(0), growth_left_(0),
+        hash_(other.hash_), equal_(other.equal_) {
+    reserve(other.size());
+    for (const_iterator it = other.begin(); it != other.end(); ++it)
+      insert(*it);
+  }
+
+  FlatHashTable(FlatHashTable&& other)
+      : ctrl_(NULL), slots_(NULL), capacity_(0), size_(0), growth_left_(0),
+        hash_(other.hash_), equal_(other.equal_) {
+    swap(other);
+  }
+
+  FlatHashTable& operator=(const FlatHashTable& other) {
+    if (this != &other) {
+      FlatHashTable copy(other);
+      swap(copy);
+    }
+    return *this;
+  }
+
+  FlatHashTable& operator=(FlatHashTable&& other) {
+    swap(other);
+    return *this;
+  }
+
+  ~FlatHashTable() {
+    DestroySlots();
+    Deallocate(ctrl_, slots_);
+  }
+
+  iterator begin() { return iterator(this, NextFull(0)); }
+  iterator end() { return iterator(this, capacity_); }
+  const_iterator begin() const { return const_iterator(this, NextFull(0)); }
+  const_iterator end() const { return const_iterator(this, capacity_); }
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  // The number of slots; the table grows when 7/8 of them are used.
+  size_t bucket_count() const { return capacity_; }
+
+  hasher hash_funct() const { return hash_; }
+  key_equal key_eq() const { return equal_; }
+
+  void clear() {
+    DestroySlots();
+    if (capacity_ > 0) {
+      memset(ctrl_, kFlatEmpty, capacity_ + kFlatGroupWidth);
+      growth_left_ = CapacityToGrowth(capacity_);
+    }
+    size_ = 0;
+  }
+
+  // Makes room for |count| elements without growing again.
+  void reserve(size_t count) {
+    size_t capacity = capacity_ == 0 ? kFlatGroupWidth : capacity_;
+    while (CapacityToGrowth(capacity) < count)
+      capacity *= 2;
+    if (count > 0 && capacity != capacity_)
+      Resize(capacity);
+  }
+  void resize(size_t count) { reserve(count); }
+
+  void swap(FlatHashTable& other) {
+    std::swap(ctrl_, other.ctrl_);
+    std::swap(slots_, other.slots_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(size_, other.size_);
+    std::swap(growth_left_, other.growth_left_);
+    std::swap(hash_, other.hash_);
+    std::swap(equal_, other.equal_);
+  }
+
+  template <typename K>
+  iterator find(const K& key) {
+    return iterator(this, Find(key));
+  }
+
+  template <typename K>
+  const_iterator find(const K& key) const {
+    return const_iterator(this, Find(key));
+  }
+
+  template <typename K>
+  size_t count(const K& key) const {
+    return Find(key) != capacity_;
+  }
+
+  std::pair<iterator, bool> insert(const value_type& value) {
+    const std::pair<size_t, bool> slot = FindOrPrepareInsert(
+        Policy::GetKey(value));
+    if (slot.second)
+      new (&slots_[slot.first]) value_type(value);
+    return std::make_pair(iterator(this, slot.first), slot.second);
+  }
+
+  std::pair<iterator, bool> insert(value_type&& value) {
+    const std::pair<size_t, bool> slot = FindOrPrepareInsert(
+        Policy::GetKey(value));
+    if (slot.second)
+      new (&slots_[slot.first]) value_type(std::move(value));
+    return std::make_pair(iterator(this, slot.first), slot.second);
+  }
+
+  template <typename InputIterator>
+  void insert(InputIterator first, InputIterator last) {
+    for (; first != last; ++first)
+      insert(*first);
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    return insert(value_type(std::forward<Args>(args)...));
+  }
+
+  void erase(iterator it) {
+    EraseAt(it.index_);
+  }
+
+  void erase(const_iterator it) {
+    EraseAt(it.index_);
+  }
+
+  void erase(const_iterator first, const_iterator last) {
+    while (first != last)
+      erase(first++);
+  }
+
+  template <typename K>
+  size_t erase(const K& key) {
+    const size_t index = Find(key);
+    if (index == capacity_)
+      return 0;
+    EraseAt(index);
+    return 1;
+  }
+
+ protected:
+  // Returns the slot of |key| and false if it is present. Otherwise marks a
+  // slot as full and returns it and true; the caller must construct a value
+  // with |key| in it before touching the table again.
+  template <typename K>
+  std::pair<size_t, bool> FindOrPrepareInsert(const K& key) {
+    const size_t hash = hash_(key);
+    const size_t index = Find(key, hash);
+    if (index != capacity_)
+      return std::make_pair(index, false);
+    return std::make_pair(PrepareInsert(hash), true);
+  }
+
+  value_type* slots() const { return slots_; }
+
+ private:
+  static size_t CapacityToGrowth(size_t capacity) {
+    return capacity - capacity / 8;
+  }
+
+  static int8 H2(size_t hash) { return static_cast<int8>(hash & 0x7f); }
+
+  template <typename K>
+  size_t Find(const K& key) const {
+    if (capacity_ == 0)
+      return 0;
+    return Find(key, hash_(key));
+  }
+
+  // Returns the slot holding |key|, or capacity_ if there is none.
+  template <typename K>
+  size_t Find(const K& key, size_t hash) const {
+    if (capacity_ == 0)
+      return 0;
+    const size_t mask = capacity_ - 1;
+    const int8 h2 = H2(hash);
+    size_t offset = (hash >> 7) & mask;
+    size_t step = 0;
+    for (;;) {
+      const int8* group = ctrl_ + offset;
+      for (uint32 match = FlatMatch(group, h2); match != 0;
+           match &= match - 1) {
+        const size_t index = (offset + __builtin_ctz(match)) & mask;
+        if (equal_(Policy::GetKey(slots_[index]), key))
+          return index;
+      }
+      if (FlatMatch(group, kFlatEmpty) != 0)
+        return capacity_;
+      step += kFlatGroupWidth;
+      offset = (offset + step) & mask;
+    }
+  }
+
+  // Returns the first empty or deleted slot on the probe sequence of |hash|.
+  size_t FindFirstNonFull(size_t hash) const {
+    const size_t mask = capacity_ - 1;
+    size_t offset = (hash >> 7) & mask;
+    size_t step = 0;
+    for (;;) {
+      const uint32 match = FlatMatchEmptyOrDeleted(ctrl_ + offset);
+      if (match != 0)
+        return (offset + __builtin_ctz(match)) & mask;
+      step += kFlatGroupWidth;
+      offset = (offset + step) & mask;
+    }
+  }
+
+  size_t PrepareInsert(size_t hash) {
+    size_t index = capacity_ == 0 ? 0 : FindFirstNonFull(hash);
+    if (growth_left_ == 0 &&
+        (capacity_ == 0 || ctrl_[index] != kFlatDeleted)) {
+      // Out of room. If deleted slots take up much of the table, rehashing
+      // at the same size reclaims them; otherwise double.
+      if (capacity_ > 0 && size_ <= CapacityToGrowth(capacity_) / 2)
+        Resize(capacity_);
+      else
+        Resize(capacity_ == 0 ? kFlatGroupWidth : capacity_ * 2);
+      index = FindFirstNonFull(hash);
+    }
+    if (ctrl_[index] == kFlatEmpty)
+      --growth_left_;
+    SetCtrl(index, H2(hash));
+    ++size_;
+    return index;
+  }
+
+  void SetCtrl(size_t index, int8 value) {
+    ctrl_[index] = value;
+    if (index < kFlatGroupWidth)
+      ctrl_[capacity_ + index] = value;
+  }
+
+  void EraseAt(size_t index) {
+    slots_[index].~value_type();
+    --size_;
+    // The slot can go back to empty only if no probe sequence ever passed
+    // over it as part of a full group, that is if every group holding it
+    // also holds an empty slot.
+    const size_t mask = capacity_ - 1;
+    const uint32 empty_after = FlatMatch(ctrl_ + index, kFlatEmpty);
+    const uint32 empty_before =
+        FlatMatch(ctrl_ + ((index - kFlatGroupWidth) & mask), kFlatEmpty);
+    const bool was_never_full =
+        empty_before != 0 && empty_after != 0 &&
+        static_cast<size_t>(__builtin_clz(empty_before << 16) +
+                            __builtin_ctz(empty_after)) < kFlatGroupWidth;
+    if (was_never_full) {
+      SetCtrl(index, kFlatEmpty);
+      ++growth_left_;
+    } else {
+      SetCtrl(index, kFlatDeleted);
+    }
+  }
+
+  // Returns the first full slot at or after |index|, or capacity_.
+  size_t NextFull(size_t index) const {
+    while (index < capacity_ && ctrl_[index] < 0)
+      ++index;
+    return index;
+  }
+
+  void Resize(size_t capacity) {
+    int8* const old_ctrl = ctrl_;
+    value_type* const old_slots = slots_;
+    const size_t old_capacity = capacity_;
+
+    ctrl_ = new int8[capacity + kFlatGroupWidth];
+    memset(ctrl_, kFlatEmpty, capacity + kFlatGroupWidth);
+    slots_ = static_cast<value_type*>(
+        ::operator new(capacity * sizeof(value_type)));
+    capacity_ = capacity;
+    growth_left_ = CapacityToGrowth(capacity) - size_;
+
+    for (size_t i = 0; i < old_capacity; ++i) {
+      if (old_ctrl[i] < 0)
+        continue;
+      const size_t hash = hash_(Policy::GetKey(old_slots[i]));
+      const size_t index = FindFirstNonFull(hash);
+      SetCtrl(index, H2(hash));
+      Policy::Transfer(&slots_[index], &old_slots[i]);
+    }
+    Deallocate(old_ctrl, old_slots);
+  }
+
+  void DestroySlots() {
+    for (size_t i = 0; i < capacity_; ++i) {
+      if (ctrl_[i] >= 0)
+        slots_[i].~value_type();
+    }
+  }
+
+  static void Deallocate(int8* ctrl, value_type* slots) {
+    delete[] ctrl;
+    ::operator delete(slots);
+  }
+
+  int8* ctrl_;
+  value_type* slots_;
+  size_t capacity_;
+  size_t size_;
+  // Insertions left before the table must grow. Deleted slots count as
+  // used until the next resize.
+  size_t growth_left_;
+  Hash hash_;
+  Equal equal_;
+};
+
+template <typename Key, typename Mapped>
+struct FlatMapPolicy {
+  typedef std::pair<const Key, Mapped> Value;
+
+  static const Key& GetKey(const Value& value) { return value.first; }
+
+  static void Transfer(Value* dst, Value* src) {
+    // Moves the key too: |src| is destroyed right after, so nothing sees
+    // its key change.
+    new (dst) Value(std::move(const_cast<Key&>(src->first)),
+                    std::move(src->second));
+    src->~Value();
+  }
+};
+
+template <typename Key>
+struct FlatSetPolicy {
+  static const Key& GetKey(const Key& value) { return value; }
+
+  static void Transfer(Key* dst, Key* src) {
+    new (dst) Key(std::move(*src));
+    src->~Key();
+  }
+};
+
+}  // namespace internal
+
+template <typename Key, typename Mapped, typename Hash = FlatHash<Key>,
+          typename Equal = FlatEqual<Key> >
+class flat_hash_map
+    : public internal::FlatHashTable<std::pair<const Key, Mapped>,
+                                     internal::FlatMapPolicy<Key, Mapped>,
+                                     Hash, Equal> {
+ private:
+  typedef internal::FlatHashTable<std::pair<const Key, Mapped>,
+                                  internal::FlatMapPolicy<Key, Mapped>,
+                                  Hash, Equal> Table;
+
+ public:
+  typedef Key key_type;
+  typedef Mapped mapped_type;
+  typedef Mapped data_type;
+
+  explicit flat_hash_map(size_t bucket_count = 0,
+                         const Hash& hash = Hash(),
+                         const Equal& equal = Equal())
+      : Table(bucket_count, hash, equal) {}
+
+  template <typename InputIterator>
+  flat_hash_map(InputIterator first, InputIterator last)
+      : Table(0, Hash(), Equal()) {
+    this->insert(first, last);
+  }
+
+  // Returns the value of |key|, inserting a value initialized one if it is
+  // not there.
+  Mapped& operator[](const Key& key) {
+    const std::pair<size_t, bool> slot = this->FindOrPrepareInsert(key);
+    if (slot.second)
+      new (&this->slots()[slot.first]) typename Table::value_type(key,
+                                                                  Mapped());
+    return this->slots()[slot.first].second;
+  }
+
+  Mapped& operator[](Key&& key) {
+    const std::pair<size_t, bool> slot = this->FindOrPrepareInsert(key);
+    if (slot.second) {
+      new (&this->slots()[slot.first]) typename Table::value_type(
+          std::move(key), Mapped());
+    }
+    return this->slots()[slot.first].second;
+  }
+};
+
+template <typename Key, typename Hash = FlatHash<Key>,
+          typename Equal = FlatEqual<Key> >
+class flat_hash_set
+    : public internal::FlatHashTable<Key, internal::FlatSetPolicy<Key>,
+                                     Hash, Equal> {
+ private:
+  typedef internal::FlatHashTable<Key, internal::FlatSetPolicy<Key>,
+                                  Hash, Equal> Table;
+
+ public:
+  typedef Key key_type;
+
+  explicit flat_hash_set(size_t bucket_count = 0,
+                         const Hash& hash = Hash(),
+                         const Equal& equal = Equal())
+      : Table(bucket_count, hash, equal) {}
+
+  template <typename InputIterator>
+  flat_hash_set(InputIterator first, InputIterator last)
+      : Table(0, Hash(), Equal()) {
+    this->insert(first, last);
+  }
+};
+
+}  // namespace base
+
+#endif  // PUBLIC_BASE_FLAT_HASH_MAP_H_
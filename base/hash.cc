@@ -1,10 +1,72 @@
 #include "base/hash.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "base/logging.h"
 #include "base/string_util.h"
 
 namespace {
 
-// IMPORTANT: DON'T CHANGE THIS VALUE.
-const uint32 kFingerPrintSeed = 19820125;
+using base::internal::kFingerPrintSeed;
+using base::internal::kMurmurHash64AMultiplier;
+using base::internal::kMurmurHash64AShift;
+
+// Mixes one 8-byte word into a MurmurHash64A state.
+inline uint64 MurmurHash64AMix(uint64 h, uint64 k) {
+  k *= kMurmurHash64AMultiplier;
+  k ^= k >> kMurmurHash64AShift;
+  k *= kMurmurHash64AMultiplier;
+  h ^= k;
+  return h * kMurmurHash64AMultiplier;
+}
+
+inline uint64 LoadWord(const uint8* p) {
+  uint64 k;
+  memcpy(&k, p, sizeof(k));
+  return k;
+}
+
+inline uint64 MurmurHash64AFinalize(uint64 h) {
+  h ^= h >> kMurmurHash64AShift;
+  h *= kMurmurHash64AMultiplier;
+  h ^= h >> kMurmurHash64AShift;
+  return h;
+}
+
+// Mixes the trailing |len| < 8 bytes at |data| into a MurmurHash64A state.
+// The bytes are gathered with two overlapping loads rather than one load
+// per byte; overlapping bytes land on the same bits.
+inline uint64 MurmurHash64ATail(uint64 h, const uint8* data, size_t len) {
+  uint64 tail;
+  if (len >= 4) {
+    uint32 first;
+    uint32 last;
+    memcpy(&first, data, sizeof(first));
+    memcpy(&last, data + len - 4, sizeof(last));
+    tail = first | (static_cast<uint64>(last) << (8 * (len - 4)));
+  } else if (len > 0) {
+    tail = data[0] |
+           (static_cast<uint64>(data[len / 2]) << (8 * (len / 2))) |
+           (static_cast<uint64>(data[len - 1]) << (8 * (len - 1)));
+  } else {
+    return h;
+  }
+  return (h ^ tail) * kMurmurHash64AMultiplier;
+}
+
+// Completes MurmurHash64A from state |h| over the remaining |len| bytes.
+inline uint64 MurmurHash64ARest(uint64 h, const uint8* data, size_t len) {
+  for (; len >= 8; data += 8, len -= 8)
+    h = MurmurHash64AMix(h, LoadWord(data));
+  return MurmurHash64AFinalize(MurmurHash64ATail(h, data, len));
+}
 }
 
 namespace base {
@@ -19,6 +81,14 @@ uint64 Fingerprint(const void* key, int len) {
   return MurmurHash64A(key, len, kFingerPrintSeed);
 }
 
+uint64 FastFingerprint(const StringPiece& str) {
+  return XXH3Hash64(str.data(), str.size(), kFingerPrintSeed);
+}
+
+uint64 FastFingerprint(const void* key, size_t len) {
+  return XXH3Hash64(key, len, kFingerPrintSeed);
+}
+
 uint32 Fingerprint32(const StringPiece& str) {
   return MurmurHash32A(str.data(),
                        str.size(),
@@ -43,8 +113,8 @@ uint64 StringToFingerprint(const std::string& str) {
 
 // 64-bit hash for 64-bit platforms
 uint64 MurmurHash64A(const void* key, int len, uint32 seed) {
-  const uint64 m = 0xc6a4a7935bd1e995;
-  const int r = 47;
+  const uint64 m = kMurmurHash64AMultiplier;
+  const int r = kMurmurHash64AShift;
 
   uint64 h = seed ^ (len * m);
 
@@ -82,6 +152,103 @@ uint64 MurmurHash64A(const void* key, int len, uint32 seed) {
   return h;
 }
 
+void MurmurHash64AHasher::Init(uint64 total_len, uint32 seed) {
+  hash_ = seed ^ (total_len * kMurmurHash64AMultiplier);
+  total_len_ = total_len;
+  len_ = 0;
+  num_pending_ = 0;
+}
+
+void MurmurHash64AHasher::Update(const void* data, size_t len) {
+  const uint8* p = static_cast<const uint8*>(data);
+  const uint8* const end = p + len;
+  len_ += len;
+
+  if (num_pending_ > 0) {
+    while (num_pending_ < 8 && p < end)
+      pending_[num_pending_++] = *p++;
+    if (num_pending_ < 8)
+      return;
+    hash_ = MurmurHash64AMix(hash_, LoadWord(pending_));
+    num_pending_ = 0;
+  }
+
+  uint64 h = hash_;
+  for (; end - p >= 8; p += 8)
+    h = MurmurHash64AMix(h, LoadWord(p));
+  hash_ = h;
+
+  while (p < end)
+    pending_[num_pending_++] = *p++;
+}
+
+uint64 MurmurHash64AHasher::Final() const {
+  DCHECK_EQ(len_, total_len_);
+  return MurmurHash64AFinalize(MurmurHash64ATail(hash_, pending_,
+                                                 num_pending_));
+}
+
+void FingerprintHasher::Init(uint64 total_len) {
+  hasher_.Init(total_len, kFingerPrintSeed);
+}
+
+void MurmurHash64ABatch(const StringPiece* keys, size_t n, uint32 seed,
+                        uint64* out) {
+  const uint64 m = kMurmurHash64AMultiplier;
+  size_t i = 0;
+  // Four keys at a time, so the multiply chains of the keys overlap. The
+  // words all four keys have run in lockstep; each key finishes alone.
+  for (; i + 4 <= n; i += 4) {
+    const StringPiece* key = keys + i;
+    const uint8* p0 = reinterpret_cast<const uint8*>(key[0].data());
+    const uint8* p1 = reinterpret_cast<const uint8*>(key[1].data());
+    const uint8* p2 = reinterpret_cast<const uint8*>(key[2].data());
+    const uint8* p3 = reinterpret_cast<const uint8*>(key[3].data());
+    const size_t len0 = key[0].size();
+    const size_t len1 = key[1].size();
+    const size_t len2 = key[2].size();
+    const size_t len3 = key[3].size();
+    uint64 h0 = seed ^ (len0 * m);
+    uint64 h1 = seed ^ (len1 * m);
+    uint64 h2 = seed ^ (len2 * m);
+    uint64 h3 = seed ^ (len3 * m);
+    const size_t common =
+        std::min(std::min(len0, len1), std::min(len2, len3)) & ~7UL;
+    for (size_t w = 0; w < common; w += 8) {
+      h0 = MurmurHash64AMix(h0, LoadWord(p0 + w));
+      h1 = MurmurHash64AMix(h1, LoadWord(p1 + w));
+      h2 = MurmurHash64AMix(h2, LoadWord(p2 + w));
+      h3 = MurmurHash64AMix(h3, LoadWord(p3 + w));
+    }
+    out[i] = MurmurHash64ARest(h0, p0 + common, len0 - common);
+    out[i + 1] = MurmurHash64ARest(h1, p1 + common, len1 - common);
+    out[i + 2] = MurmurHash64ARest(h2, p2 + common, len2 - common);
+    out[i + 3] = MurmurHash64ARest(h3, p3 + common, len3 - common);
+  }
+  for (; i < n; ++i) {
+    out[i] = MurmurHash64ARest(seed ^ (keys[i].size() * m),
+                               reinterpret_cast<const uint8*>(keys[i].data()),
+                               keys[i].size());
+  }
+}
+
+void MurmurHash64ABatch(const uint64* keys, size_t n, uint32 seed,
+                        uint64* out) {
+  // The keys are independent, so the compiler and the processor overlap
+  // the multiplies of successive iterations.
+  const uint64 h = seed ^ (8 * kMurmurHash64AMultiplier);
+  for (size_t i = 0; i < n; ++i)
+    out[i] = MurmurHash64AFinalize(MurmurHash64AMix(h, keys[i]));
+}
+
+void FingerprintBatch(const StringPiece* keys, size_t n, uint64* out) {
+  MurmurHash64ABatch(keys, n, kFingerPrintSeed, out);
+}
+
+void FingerprintBatch(const uint64* keys, size_t n, uint64* out) {
+  MurmurHash64ABatch(keys, n, kFingerPrintSeed, out);
+}
+
 // 32-bit hash
 uint32 MurmurHash32A(const void* key, int len, uint32 seed) {
   const uint32 m = 0x5bd1e995;
@@ -189,6 +356,9 @@ namespace {
 
 const int kFNV_128_DIGEST_SIZE = 16;
 
+const uint64 kFNV_128_INIT_LOW = 0x62B821756295C58DULL;
+const uint64 kFNV_128_INIT_HIGH = 0x6C62272E07BB0142ULL;
+
 // 128bit prime = 2^88 + 2^8 + 0x3b
 const uint32 kFNV_128_PRIME_LOW = 0x13b;
 const uint32 kFNV_128_PRIME_SHIFT = 24;
@@ -226,6 +396,78 @@ void FNVUpdate(const char c, uint64* val) {
   val[2] = tmp[2] & 0x00000000ffffffffULL;
 }
 
+#if defined(__SIZEOF_INT128__)
+// FNVUpdate() on the 128-bit state held as two 64-bit words, using a native
+// 64x64->128 multiply.
+//
+// FNVUpdate() xors the sign extended char into the 32-bit low limb. For a
+// byte >= 0x80 that sets the top half of the limb, and its first 64-bit
+// multiply drops the carry out of that half. Worked out over the whole
+// product, such a byte adds a constant,
+//   2^64 - 2^120 - kFNV_128_PRIME_LOW * 2^32 (mod 2^128),
+// to the plain 128-bit product, which keeps the digests bit-identical.
+const uint64 kFNV_128_HIGH_BYTE_FIXUP_LOW = 0xfffffec500000000ULL;
+const uint64 kFNV_128_HIGH_BYTE_FIXUP_HIGH = 0xff00000000000000ULL;
+
+inline void FNV128Step(char c, uint64* lo, uint64* hi) {
+  const uint64 x = *lo ^ static_cast<uint32>(static_cast<int32>(c));
+  // All ones if |c| is negative.
+  const uint64 high_byte = static_cast<uint64>(static_cast<int64>(c) >> 63);
+
+  // (hi:x) * (2^88 + kFNV_128_PRIME_LOW) mod 2^128, plus the fixup. Plain
+  // 64-bit halves keep the compiler from spilling 128-bit temporaries.
+  const unsigned __int128 low_product =
+      static_cast<unsigned __int128>(x) * kFNV_128_PRIME_LOW;
+  const uint64 fixup_low = kFNV_128_HIGH_BYTE_FIXUP_LOW & high_byte;
+  const uint64 new_lo = static_cast<uint64>(low_product) + fixup_low;
+  *hi = *hi * kFNV_128_PRIME_LOW + (x << kFNV_128_PRIME_SHIFT) +
+        static_cast<uint64>(low_product >> 64) +
+        (kFNV_128_HIGH_BYTE_FIXUP_HIGH & high_byte) + (new_lo < fixup_low);
+  *lo = new_lo;
+}
+#endif
+
+// Feeds |len| bytes to the FNV128 state |word|, low word first.
+void FNV128Update(const char* data, size_t len, uint64* word) {
+#if defined(__SIZEOF_INT128__)
+  uint64 lo = word[0];
+  uint64 hi = word[1];
+  const char* end = data + len;
+  while (end - data >= 8) {
+    FNV128Step(data[0], &lo, &hi);
+    FNV128Step(data[1], &lo, &hi);
+    FNV128Step(data[2], &lo, &hi);
+    FNV128Step(data[3], &lo, &hi);
+    FNV128Step(data[4], &lo, &hi);
+    FNV128Step(data[5], &lo, &hi);
+    FNV128Step(data[6], &lo, &hi);
+    FNV128Step(data[7], &lo, &hi);
+    data += 8;
+  }
+  while (data < end)
+    FNV128Step(*data++, &lo, &hi);
+
+  word[0] = lo;
+  word[1] = hi;
+#else
+  uint64 val[4];
+
+  val[0] = (word[0] & 0x00000000ffffffffULL);
+  val[1] = (word[0] >> 32);
+  val[2] = (word[1] & 0x00000000ffffffffULL);
+  val[3] = (word[1] >> 32);
+
+  size_t pos = 0;
+  while (pos < len) {
+    FNVUpdate(*data++, val);
+    ++pos;
+  }
+
+  word[1] = ((val[3]<<32) | val[2]);
+  word[0] = ((val[1]<<32) | val[0]);
+#endif
+}
+
 bool IsScriptTag(const char* data) {
   if ((data[0] == 's' || data[0] == 'S') &&
       (data[1] == 'c' || data[1] == 'C') &&
@@ -270,6 +512,136 @@ bool IsMetaTag(const char* data) {
   return false;
 }
 
+inline bool IsTextBreak(char c) {
+  // Space, '<', and '\t' through '\r'.
+  return c == ' ' || c == '<' || static_cast<uint8>(c - '\t') <= 4;
+}
+
+// Returns the first whitespace or '<' in [p, end), or |end|.
+const char* FindTextBreak(const char* p, const char* end) {
+#if defined(__SSE2__)
+  const __m128i kLess = _mm_set1_epi8('<');
+  const __m128i kSpace = _mm_set1_epi8(' ');
+  const __m128i kTab = _mm_set1_epi8('\t');
+  const __m128i kFour = _mm_set1_epi8(4);
+  for (; end - p >= 16; p += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i control = _mm_sub_epi8(v, kTab);
+    const __m128i is_control = _mm_cmpeq_epi8(_mm_min_epu8(control, kFour),
+                                              control);
+    const __m128i is_break = _mm_or_si128(
+        is_control,
+        _mm_or_si128(_mm_cmpeq_epi8(v, kLess), _mm_cmpeq_epi8(v, kSpace)));
+    const int mask = _mm_movemask_epi8(is_break);
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+#endif
+  for (; p < end; ++p) {
+    if (IsTextBreak(*p))
+      return p;
+  }
+  return end;
+}
+
+// Returns the position past the first |c| in [p, end), or |end|.
+inline const char* SkipPast(const char* p, const char* end, char c) {
+  const void* found = memchr(p, c, end - p);
+  return found ? static_cast<const char*>(found) + 1 : end;
+}
+
+// Returns the position past the "</" and name of the first end tag that
+// |is_tag| accepts in [p, end), or |end|.
+const char* SkipToEndTag(const char* p, const char* end,
+                         bool (*is_tag)(const char*), int name_len) {
+  while (end - p >= 2 + name_len) {
+    const char* lt = static_cast<const char*>(memchr(p, '<', end - p));
+    if (lt == NULL || end - lt < 2 + name_len)
+      break;
+    if (lt[1] == '/' && is_tag(lt + 2))
+      return lt + 2 + name_len;
+    p = lt + 1;
+  }
+  return end;
+}
+
+// True if the tag name |name_len| long at |p| ends there.
+inline bool EndsTagName(const char* p, const char* end, int name_len) {
+  if (end - p < name_len)
+    return false;
+  if (end - p == name_len)
+    return true;
+  const char c = p[name_len];
+  return c == '>' || c == '/' || IsTextBreak(c);
+}
+
+// Hashes the visible text of the HTML in [p, end) into the FNV128 state
+// |word|, see HTMLContentHash().
+void HTMLContentUpdate(const char* p, const char* end, uint64* word) {
+  CHashParserSate state = kInText;
+  // Whitespace and tags seen since the last text; they become one space
+  // once more text follows.
+  bool pending_space = false;
+  bool has_text = false;
+  while (p < end) {
+    switch (state) {
+      case kInText:
+      case kInTitle: {
+        const char* text_end = FindTextBreak(p, end);
+        if (text_end > p) {
+          if (pending_space && has_text)
+            FNV128Update(" ", 1, word);
+          FNV128Update(p, text_end - p, word);
+          has_text = true;
+          pending_space = false;
+        }
+        if (text_end == end)
+          return;
+        p = text_end + 1;
+        if (*text_end != '<') {
+          pending_space = true;
+          break;
+        }
+        if (p < end && (isalpha(static_cast<unsigned char>(*p)) ||
+                        *p == '/' || *p == '!' || *p == '?')) {
+          pending_space = true;
+          if (end - p >= 3 && memcmp(p, "!--", 3) == 0) {
+            const char* comment_end = static_cast<const char*>(
+                memmem(p + 3, end - p - 3, "-->", 3));
+            p = comment_end ? comment_end + 3 : end;
+          } else if (EndsTagName(p, end, 6) && IsScriptTag(p)) {
+            state = kInScript;
+          } else if (EndsTagName(p, end, 5) && IsStyleTag(p)) {
+            state = kInStyle;
+          } else {
+            state = kInTag;
+          }
+        } else {
+          // A '<' that starts no tag is text, as in "a < b".
+          if (pending_space && has_text)
+            FNV128Update(" ", 1, word);
+          FNV128Update("<", 1, word);
+          has_text = true;
+          pending_space = false;
+        }
+        break;
+      }
+      case kInTag:
+        p = SkipPast(p, end, '>');
+        state = kInText;
+        break;
+      case kInScript:
+        p = SkipToEndTag(p, end, IsScriptTag, 6);
+        state = kInTag;
+        break;
+      case kInStyle:
+        p = SkipToEndTag(p, end, IsStyleTag, 5);
+        state = kInTag;
+        break;
+    }
+  }
+}
+
 } // namespace
 
 namespace base {
@@ -285,8 +657,8 @@ void FNV128(const char* data, int len, void* digest) {
     uint64 word[2];
   } HashVal;
 
-  HashVal.word[0] = 0x62B821756295C58DULL;
-  HashVal.word[1] = 0x6C62272E07BB0142ULL;
+  HashVal.word[0] = kFNV_128_INIT_LOW;
+  HashVal.word[1] = kFNV_128_INIT_HIGH;
 
   // If DataLen is zero, then hashing is not needed.
   if (len == 0) {
@@ -294,44 +666,28 @@ void FNV128(const char* data, int len, void* digest) {
     return;
   }
 
-  uint64 val[4];
-
-  val[0] = (HashVal.word[0] & 0x00000000ffffffffULL);
-  val[1] = (HashVal.word[0] >> 32);
-  val[2] = (HashVal.word[1] & 0x00000000ffffffffULL);
-  val[3] = (HashVal.word[1] >> 32);
-
-  int pos = 0;
-  while (pos < len) {
-    val[0] ^= static_cast<uint64>(*data++);
-    ++pos;
-
-    // Multiplication
-    uint64 tmp[4];
-
-    tmp[0] = val[0] * kFNV_128_PRIME_LOW;
-    tmp[1] = val[1] * kFNV_128_PRIME_LOW;
-    tmp[2] = val[2] * kFNV_128_PRIME_LOW;
-    tmp[3] = val[3] * kFNV_128_PRIME_LOW;
-
-    tmp[2] += val[0] << kFNV_128_PRIME_SHIFT;
-    tmp[3] += val[1] << kFNV_128_PRIME_SHIFT;
-
-    // Propagate carries
-    tmp[1] += (tmp[0] >> 32);
-    val[0] = tmp[0] & 0x00000000ffffffffULL;
+  FNV128Update(data, len, HashVal.word);
+  memcpy(digest, HashVal.word, kFNV_128_DIGEST_SIZE);
+}
 
-    tmp[2] += (tmp[1] >> 32);
-    val[1] = tmp[1] & 0x00000000ffffffffULL;
+void HTMLContentHash(const char* data, int len, void* digest) {
+  uint64 word[2] = { kFNV_128_INIT_LOW, kFNV_128_INIT_HIGH };
+  if (data != NULL && len > 0)
+    HTMLContentUpdate(data, data + len, word);
+  memcpy(digest, word, kFNV_128_DIGEST_SIZE);
+}
 
-    val[3] = tmp[3] + (tmp[2] >> 32);
-    val[2] = tmp[2] & 0x00000000ffffffffULL;
-  }
+void FNV128Hasher::Init() {
+  word_[0] = kFNV_128_INIT_LOW;
+  word_[1] = kFNV_128_INIT_HIGH;
+}
 
-  HashVal.word[1] = ((val[3]<<32) | val[2]);
-  HashVal.word[0] = ((val[1]<<32) | val[0]);
+void FNV128Hasher::Update(const char* data, size_t len) {
+  FNV128Update(data, len, word_);
+}
 
-  memcpy(digest, HashVal.word, kFNV_128_DIGEST_SIZE);
+void FNV128Hasher::Final(void* digest) const {
+  memcpy(digest, word_, kFNV_128_DIGEST_SIZE);
 }
 
 }  // namespace base
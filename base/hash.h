@@ -29,6 +29,90 @@ uint32 MurmurHash32A(const void* key, int len, uint32 seed);
 
 uint32 MurmurHash3_32(const void* key, int len, uint32 seed);
 
+// Batch versions: out[i] is the hash of keys[i], the same as the one-shot
+// function gives. Several keys are hashed per loop iteration so their
+// multiply chains overlap, which is much faster than one call per key for
+// millions of short keys. The uint64 versions hash each key's 8 bytes, as
+// in Fingerprint(&key, sizeof(key)).
+void FingerprintBatch(const StringPiece* keys, size_t n, uint64* out);
+
+void FingerprintBatch(const uint64* keys, size_t n, uint64* out);
+
+void MurmurHash64ABatch(const StringPiece* keys, size_t n, uint32 seed,
+                        uint64* out);
+
+void MurmurHash64ABatch(const uint64* keys, size_t n, uint32 seed,
+                        uint64* out);
+
+namespace internal {
+
+// IMPORTANT: DON'T CHANGE THIS VALUE.
+const uint32 kFingerPrintSeed = 19820125;
+
+// Pieces of ConstMurmurHash64A(), written as single return statements so
+// they are C++11 constexpr functions.
+
+const uint64 kMurmurHash64AMultiplier = 0xc6a4a7935bd1e995ULL;
+const int kMurmurHash64AShift = 47;
+
+constexpr uint64 MurmurByte(const char* str, size_t i) {
+  return static_cast<uint64>(static_cast<uint8>(str[i]));
+}
+
+// The |n| bytes at |str| as a little endian integer.
+constexpr uint64 MurmurBytes(const char* str, size_t n) {
+  return n == 0 ? 0 : (MurmurByte(str, n - 1) << (8 * (n - 1))) |
+                      MurmurBytes(str, n - 1);
+}
+
+constexpr uint64 MurmurShiftMix(uint64 h) {
+  return h ^ (h >> kMurmurHash64AShift);
+}
+
+constexpr uint64 MurmurMix(uint64 h, uint64 k) {
+  return (h ^ (MurmurShiftMix(k * kMurmurHash64AMultiplier) *
+               kMurmurHash64AMultiplier)) * kMurmurHash64AMultiplier;
+}
+
+constexpr uint64 MurmurTail(uint64 h, const char* str, size_t n) {
+  return n == 0 ? h : (h ^ MurmurBytes(str, n)) * kMurmurHash64AMultiplier;
+}
+
+// Mixes in the words of the |len| bytes at |str|, then the tail.
+constexpr uint64 MurmurBody(uint64 h, const char* str, size_t len) {
+  return len < 8 ? MurmurTail(h, str, len)
+                 : MurmurBody(MurmurMix(h, MurmurBytes(str, 8)), str + 8,
+                              len - 8);
+}
+
+}  // namespace internal
+
+// MurmurHash64A() and Fingerprint() evaluated at compile time, for hashes
+// of string literals in case labels and static tables. They give the same
+// values as the runtime functions, so
+//   switch (base::Fingerprint(name)) {
+//     case base::ConstFingerprint("width"): ...
+// works. Strings are limited to about 4 KB by the compiler's constexpr
+// recursion depth.
+constexpr uint64 ConstMurmurHash64A(const char* str, size_t len,
+                                    uint32 seed) {
+  return internal::MurmurShiftMix(
+      internal::MurmurShiftMix(
+          internal::MurmurBody(
+              seed ^ (len * internal::kMurmurHash64AMultiplier), str, len)) *
+      internal::kMurmurHash64AMultiplier);
+}
+
+constexpr uint64 ConstFingerprint(const char* str, size_t len) {
+  return ConstMurmurHash64A(str, len, internal::kFingerPrintSeed);
+}
+
+// Fingerprint of a string literal, without its terminating NUL.
+template <size_t N>
+constexpr uint64 ConstFingerprint(const char (&str)[N]) {
+  return ConstFingerprint(str, N - 1);
+}
+
 static const uint64 kEmptyContentHashLow = 7113472399480571277UL;
 static const uint64 kEmptyContentHashHigh = 7809847782465536322UL;
 
@@ -39,6 +123,111 @@ static const uint64 kEmptyContentHashHigh = 7809847782465536322UL;
 //
 void FNV128(const char* data, int len, void* digest);
 
+// FNV128() of the visible text of an HTML page, for finding pages with the
+// same content. Markup, comments, and the contents of <script> and <style>
+// are dropped. Each run of whitespace and tags between two pieces of text
+// becomes a single space, and leading and trailing ones are dropped. A page
+// with no text hashes to kEmptyContentHashLow and kEmptyContentHashHigh.
+// The page is scanned once, 16 bytes at a time for the text.
+void HTMLContentHash(const char* data, int len, void* digest);
+
+// XXH3 from xxHash 0.8, a fast non-cryptographic hash. Long inputs run at
+// memory speed, using SSE2, or AVX2 when the processor supports it. The
+// values are those of XXH3_64bits_withSeed() and XXH3_128bits_withSeed(),
+// so they can be checked against, and shared with, other implementations.
+struct Hash128 {
+  uint64 low;
+  uint64 high;
+};
+
+uint64 XXH3Hash64(const void* key, size_t len, uint64 seed);
+
+Hash128 XXH3Hash128(const void* key, size_t len, uint64 seed);
+
+// Like Fingerprint(), but several times faster on long strings. The values
+// differ from Fingerprint(), so stored fingerprints cannot be compared
+// across the two; move callers over one key space at a time.
+uint64 FastFingerprint(const StringPiece& str);
+
+uint64 FastFingerprint(const void* key, size_t len);
+
+// Streaming versions of the hashes above, for input that arrives in pieces,
+// such as a large file read in chunks. Feeding the same bytes in any split
+// gives the same result as the one-shot function. Whole 8-byte words are
+// read straight from the caller's buffer; only a partial word is held back
+// between calls.
+//
+// MurmurHash64A mixes the length in before the data, so the total length
+// must be known up front and passed to Init().
+//
+// Usage:
+//   base::FingerprintHasher hasher;
+//   hasher.Init(file_size);
+//   while (reader.Read(&chunk))
+//     hasher.Update(chunk);
+//   uint64 fp = hasher.Final();
+class MurmurHash64AHasher {
+ public:
+  MurmurHash64AHasher() { Init(0, 0); }
+
+  // Starts a new hash of |total_len| bytes.
+  void Init(uint64 total_len, uint32 seed);
+
+  void Update(const void* data, size_t len);
+  void Update(const StringPiece& data) { Update(data.data(), data.size()); }
+
+  // Returns MurmurHash64A() of the bytes passed to Update() since Init(),
+  // which must add up to |total_len|. Does not change the state.
+  uint64 Final() const;
+
+ private:
+  uint64 hash_;
+  uint64 total_len_;
+  uint64 len_;
+  uint8 pending_[8];
+  int num_pending_;
+
+  DISALLOW_COPY_AND_ASSIGN(MurmurHash64AHasher);
+};
+
+// Fingerprint() of input given in pieces.
+class FingerprintHasher {
+ public:
+  FingerprintHasher() { Init(0); }
+
+  void Init(uint64 total_len);
+
+  void Update(const void* data, size_t len) { hasher_.Update(data, len); }
+  void Update(const StringPiece& data) { hasher_.Update(data); }
+
+  uint64 Final() const { return hasher_.Final(); }
+
+ private:
+  MurmurHash64AHasher hasher_;
+
+  DISALLOW_COPY_AND_ASSIGN(FingerprintHasher);
+};
+
+// FNV128() of input given in pieces. The length need not be known.
+class FNV128Hasher {
+ public:
+  FNV128Hasher() { Init(); }
+
+  void Init();
+
+  void Update(const char* data, size_t len);
+  void Update(const StringPiece& data) { Update(data.data(), data.size()); }
+
+  // Writes the 16-byte digest of the bytes passed to Update() since Init().
+  // Does not change the state.
+  void Final(void* digest) const;
+
+ private:
+  uint64 word_[2];
+
+  DISALLOW_COPY_AND_ASSIGN(FNV128Hasher);
+};
+
 }  // namespace base
 
 #endif  // PUBLIC_BASE_HASH_H_
@@ -38,8 +38,10 @@
 #undef CHROME_OLD__DEPRECATED
 #endif
 
+#include "base/hash.h"
 #include "base/port.h"
 #include "base/string16.h"
+#include "base/string_piece.h"
 
 namespace base {
 using __gnu_cxx::hash_map;
@@ -67,24 +69,23 @@ DEFINE_TRIVIAL_HASH(unsigned long long);
 #undef DEFINE_TRIVIAL_HASH
 
 // Implement string hash functions so that strings of various flavors can
-// be used as keys in STL maps and sets.  The hash algorithm comes from the
-// GNU C++ library, in <tr1/functional>.  It is duplicated here because GCC
-// versions prior to 4.3.2 are unable to compile <tr1/functional> when RTTI
-// is disabled, as it is in our build.
+// be used as keys in STL maps and sets.  The strings are hashed a word at a
+// time with XXH3 from base/hash.h, which is fast on long keys and spreads
+// keys that differ in a few characters, such as URLs of the same site.  A
+// std::string and a StringPiece with the same bytes hash the same.
 
 #define DEFINE_STRING_HASH(string_type) \
     template<> \
     struct hash<string_type> { \
       std::size_t operator()(const string_type& s) const { \
-        std::size_t result = 0; \
-        for (string_type::const_iterator i = s.begin(); i != s.end(); ++i) \
-          result = (result * 131) + *i; \
-        return result; \
+        return static_cast<std::size_t>(base::XXH3Hash64( \
+            s.data(), s.size() * sizeof(string_type::value_type), 0)); \
       } \
     }
 
 DEFINE_STRING_HASH(std::string);
 DEFINE_STRING_HASH(std::wstring);
+DEFINE_STRING_HASH(base::StringPiece);
 
 #if defined(WCHAR_T_IS_UTF32)
 // If string16 and std::wstring are not the same type, provide a
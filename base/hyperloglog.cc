@@ -0,0 +1,371 @@
+#include "base/hyperloglog.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#include "base/atomicops.h"
+#endif
+
+namespace {
+
+const char kMagic[4] = { 'H', 'L', 'L', '1' };
+const uint8 kSparseFormat = 0;
+const uint8 kDenseFormat = 1;
+
+// The rank of a hash with |precision| bits of index: one more than the
+// number of leading zeros of the bits after the index, at most
+// 65 - |precision|.
+inline uint32 Rank(uint64 fp, int precision) {
+  const uint64 rest = fp << precision;
+  return rest ? __builtin_clzll(rest) + 1 : 65 - precision;
+}
+
+// dst[i] = max(dst[i], src[i]) for the |n| registers.
+void MaxRegistersScalar(uint8* dst, const uint8* src, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    dst[i] = std::max(dst[i], src[i]);
+}
+
+#if defined(__x86_64__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+void MaxRegistersAvx2(uint8* dst, const uint8* src, size_t n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i* d = reinterpret_cast<__m256i*>(dst + i);
+    const __m256i s =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(d, _mm256_max_epu8(_mm256_loadu_si256(d), s));
+  }
+  MaxRegistersScalar(dst + i, src + i, n - i);
+}
+
+#pragma GCC pop_options
+
+void MaxRegistersSse2(uint8* dst, const uint8* src, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i* d = reinterpret_cast<__m128i*>(dst + i);
+    const __m128i s =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(d, _mm_max_epu8(_mm_loadu_si128(d), s));
+  }
+  MaxRegistersScalar(dst + i, src + i, n - i);
+}
+#endif  // __x86_64__
+
+void MaxRegisters(uint8* dst, const uint8* src, size_t n) {
+#if defined(__x86_64__)
+  if (AtomicOps_Internalx86CPUFeatures.has_avx2)
+    MaxRegistersAvx2(dst, src, n);
+  else
+    MaxRegistersSse2(dst, src, n);
+#else
+  MaxRegistersScalar(dst, src, n);
+#endif
+}
+
+// Helpers of Ertl's estimator, "New cardinality estimation algorithms for
+// HyperLogLog sketches", 2017.
+double Sigma(double x) {
+  if (x == 1.0)
+    return HUGE_VAL;
+  double y = 1.0;
+  double z = x;
+  double previous;
+  do {
+    x *= x;
+    previous = z;
+    z += x * y;
+    y += y;
+  } while (z != previous);
+  return z;
+}
+
+double Tau(double x) {
+  if (x == 0.0 || x == 1.0)
+    return 0.0;
+  double y = 1.0;
+  double z = 1.0 - x;
+  double previous;
+  do {
+    x = sqrt(x);
+    previous = z;
+    y *= 0.5;
+    z -= (1.0 - x) * (1.0 - x) * y;
+  } while (z != previous);
+  return z / 3.0;
+}
+
+// Estimates the cardinality from |counts|[k], the number of the |m|
+// registers of rank k, for k in [0, q + 1].
+double EstimateFromCounts(const std::vector<double>& counts, double m) {
+  const int q = static_cast<int>(counts.size()) - 2;
+  if (counts[0] == m)
+    return 0.0;
+  double z = m * Tau(1.0 - counts[q + 1] / m);
+  for (int k = q; k >= 1; --k)
+    z = 0.5 * (z + counts[k]);
+  z += m * Sigma(counts[0] / m);
+  return m * m / (2.0 * M_LN2 * z);
+}
+
+// Sorts |pending| and merges it with |sparse|, both sparse entries, into
+// |out|, keeping the highest rank per index.
+void MergeSparse(const std::vector<uint32>& sparse,
+                 std::vector<uint32>* pending, std::vector<uint32>* out) {
+  std::sort(pending->begin(), pending->end());
+  out->resize(sparse.size() + pending->size());
+  std::merge(sparse.begin(), sparse.end(), pending->begin(), pending->end(),
+             out->begin());
+  // Entries of one index are ordered by rank; keep the last.
+  size_t size = 0;
+  for (size_t i = 0; i < out->size(); ++i) {
+    if (size > 0 && ((*out)[size - 1] >> 6) == ((*out)[i] >> 6))
+      --size;
+    (*out)[size++] = (*out)[i];
+  }
+  out->resize(size);
+}
+
+void AppendVarint32(uint32 value, std::string* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+bool ParseVarint32(const char** p, const char* end, uint32* value) {
+  uint32 result = 0;
+  for (int shift = 0; shift <= 28 && *p < end; shift += 7) {
+    const uint32 byte = static_cast<uint8>(*(*p)++);
+    result |= (byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+namespace base {
+
+HyperLogLog::HyperLogLog(int precision) : precision_(precision) {
+  CHECK_GE(precision, kMinPrecision);
+  CHECK_LE(precision, kMaxPrecision);
+}
+
+void HyperLogLog::AddFingerprint(uint64 fp) {
+  if (!registers_.empty()) {
+    uint8& reg = registers_[fp >> (64 - precision_)];
+    reg = std::max(reg, static_cast<uint8>(Rank(fp, precision_)));
+    return;
+  }
+  const uint32 index = static_cast<uint32>(fp >> (64 - kSparsePrecision));
+  pending_.push_back(index << 6 | Rank(fp, kSparsePrecision));
+  if (pending_.size() >= (static_cast<size_t>(1) << precision_) / 16)
+    FlushSparse();
+}
+
+void HyperLogLog::FlushSparse() {
+  if (pending_.empty())
+    return;
+  std::vector<uint32> merged;
+  MergeSparse(sparse_, &pending_, &merged);
+  sparse_.swap(merged);
+  pending_.clear();
+  if (sparse_.size() > MaxSparseSize())
+    ToDense();
+}
+
+const std::vector<uint32>& HyperLogLog::FlushedSparse(
+    std::vector<uint32>* scratch) const {
+  if (pending_.empty())
+    return sparse_;
+  std::vector<uint32> pending(pending_);
+  MergeSparse(sparse_, &pending, scratch);
+  return *scratch;
+}
+
+void HyperLogLog::AddSparseToRegisters(uint32 entry, uint8* registers) const {
+  const int extra_bits = kSparsePrecision - precision_;
+  const uint32 sparse_index = entry >> 6;
+  const uint32 low = sparse_index & ((1U << extra_bits) - 1);
+  // The index bits beyond |precision_| come first in the dense rank.
+  const uint32 rank = low ? __builtin_clz(low) - (32 - extra_bits) + 1
+                          : extra_bits + (entry & 63);
+  uint8& reg = registers[sparse_index >> extra_bits];
+  reg = std::max(reg, static_cast<uint8>(rank));
+}
+
+void HyperLogLog::SparseToRegisters(const std::vector<uint32>& sparse,
+                                    std::vector<uint8>* registers) const {
+  registers->assign(static_cast<size_t>(1) << precision_, 0);
+  for (size_t i = 0; i < sparse.size(); ++i)
+    AddSparseToRegisters(sparse[i], &(*registers)[0]);
+}
+
+void HyperLogLog::ToDense() {
+  SparseToRegisters(sparse_, &registers_);
+  for (size_t i = 0; i < pending_.size(); ++i)
+    AddSparseToRegisters(pending_[i], &registers_[0]);
+  std::vector<uint32>().swap(sparse_);
+  std::vector<uint32>().swap(pending_);
+}
+
+uint64 HyperLogLog::Estimate() const {
+  std::vector<uint32> scratch;
+  const std::vector<uint32>& sparse =
+      registers_.empty() ? FlushedSparse(&scratch) : sparse_;
+  std::vector<uint8> flushed_registers;
+  const std::vector<uint8>* registers = &registers_;
+  if (registers_.empty() && sparse.size() > MaxSparseSize()) {
+    // Estimated as the dense counter a flush would turn it into.
+    SparseToRegisters(sparse, &flushed_registers);
+    registers = &flushed_registers;
+  }
+
+  std::vector<double> counts;
+  double m;
+  if (registers->empty()) {
+    // The sparse entries are the nonzero registers of a counter at the
+    // sparse precision.
+    m = static_cast<double>(1 << kSparsePrecision);
+    counts.assign(66 - kSparsePrecision, 0.0);
+    counts[0] = m - sparse.size();
+    for (size_t i = 0; i < sparse.size(); ++i)
+      counts[sparse[i] & 63] += 1.0;
+  } else {
+    m = static_cast<double>(registers->size());
+    uint32 histogram[66] = { 0 };
+    for (size_t i = 0; i < registers->size(); ++i)
+      ++histogram[(*registers)[i]];
+    counts.assign(histogram, histogram + 66 - precision_);
+  }
+  return static_cast<uint64>(EstimateFromCounts(counts, m) + 0.5);
+}
+
+bool HyperLogLog::Merge(const HyperLogLog& other) {
+  if (other.precision_ != precision_)
+    return false;
+  if (other.registers_.empty()) {
+    std::vector<uint32> scratch;
+    const std::vector<uint32>& other_sparse = other.FlushedSparse(&scratch);
+    if (registers_.empty()) {
+      pending_.insert(pending_.end(), other_sparse.begin(),
+                      other_sparse.end());
+      FlushSparse();
+    } else {
+      for (size_t i = 0; i < other_sparse.size(); ++i)
+        AddSparseToRegisters(other_sparse[i], &registers_[0]);
+    }
+    return true;
+  }
+  if (registers_.empty())
+    ToDense();
+  MaxRegisters(&registers_[0], &other.registers_[0], registers_.size());
+  return true;
+}
+
+void HyperLogLog::Clear() {
+  sparse_.clear();
+  pending_.clear();
+  std::vector<uint8>().swap(registers_);
+}
+
+void HyperLogLog::SerializeTo(std::string* out) const {
+  std::vector<uint32> scratch;
+  const std::vector<uint32>& sparse =
+      registers_.empty() ? FlushedSparse(&scratch) : sparse_;
+  std::vector<uint8> flushed_registers;
+  const std::vector<uint8>* registers = &registers_;
+  if (registers_.empty() && sparse.size() > MaxSparseSize()) {
+    SparseToRegisters(sparse, &flushed_registers);
+    registers = &flushed_registers;
+  }
+
+  out->append(kMagic, sizeof(kMagic));
+  out->push_back(static_cast<char>(precision_));
+  if (registers->empty()) {
+    // Sorted entries, as varint deltas.
+    out->push_back(static_cast<char>(kSparseFormat));
+    AppendVarint32(static_cast<uint32>(sparse.size()), out);
+    uint32 previous = 0;
+    for (size_t i = 0; i < sparse.size(); ++i) {
+      AppendVarint32(sparse[i] - previous, out);
+      previous = sparse[i];
+    }
+  } else {
+    out->push_back(static_cast<char>(kDenseFormat));
+    out->append(reinterpret_cast<const char*>(&(*registers)[0]),
+                registers->size());
+  }
+}
+
+bool HyperLogLog::Deserialize(const StringPiece& data) {
+  const size_t header = sizeof(kMagic) + 2;
+  if (data.size() < header || memcmp(data.data(), kMagic, sizeof(kMagic)))
+    return false;
+  const int precision = static_cast<uint8>(data[sizeof(kMagic)]);
+  const uint8 format = static_cast<uint8>(data[sizeof(kMagic) + 1]);
+  if (precision < kMinPrecision || precision > kMaxPrecision)
+    return false;
+  const char* p = data.data() + header;
+  const char* end = data.data() + data.size();
+
+  if (format == kDenseFormat) {
+    const size_t m = static_cast<size_t>(1) << precision;
+    if (static_cast<size_t>(end - p) != m)
+      return false;
+    std::vector<uint8> registers(p, end);
+    for (size_t i = 0; i < m; ++i) {
+      if (registers[i] > 65 - precision)
+        return false;
+    }
+    precision_ = precision;
+    sparse_.clear();
+    pending_.clear();
+    registers_.swap(registers);
+    return true;
+  }
+
+  uint32 size;
+  if (format != kSparseFormat || !ParseVarint32(&p, end, &size) ||
+      size > static_cast<uint32>(end - p)) {
+    return false;
+  }
+  std::vector<uint32> sparse(size);
+  uint32 previous = 0;
+  for (uint32 i = 0; i < size; ++i) {
+    uint32 delta;
+    if (!ParseVarint32(&p, end, &delta))
+      return false;
+    const uint64 entry = static_cast<uint64>(previous) + delta;
+    const uint32 rank = entry & 63;
+    if (entry >> (kSparsePrecision + 6) != 0 || rank == 0 ||
+        rank > 65 - kSparsePrecision ||
+        (i > 0 && (entry >> 6) <= (previous >> 6))) {
+      return false;
+    }
+    sparse[i] = previous = static_cast<uint32>(entry);
+  }
+  if (p != end)
+    return false;
+  precision_ = precision;
+  sparse_.swap(sparse);
+  pending_.clear();
+  std::vector<uint8>().swap(registers_);
+  return true;
+}
+
+}  // namespace base
@@ -0,0 +1,109 @@
+// Description : HyperLogLog++ distinct counter. Estimates the number of
+//               distinct keys in a stream in at most 2^precision bytes, with
+//               a relative standard error of about 1.04 / sqrt(2^precision):
+//               0.8% at the default precision 14, in 16 KB. Small sets are
+//               kept in a sparse list of 25-bit register indexes, exact in
+//               practice, of at most 2^precision / 4 entries: 4096 at the
+//               default precision. Past that the list would take more room
+//               than the dense registers, which replace it. Estimates use
+//               Ertl's improved estimator, which needs no empirical bias
+//               tables over the whole range.
+//
+//               Counters of the same precision merge into the counter of
+//               the union, so shards can count separately, serialize, and
+//               be combined anywhere.
+//
+// Usage:
+//   base::HyperLogLog users;
+//   users.Add(user_id);
+//   ...
+//   std::string bytes;
+//   users.SerializeTo(&bytes);
+//   ...
+//   base::HyperLogLog total, shard;
+//   if (shard.Deserialize(bytes)) total.Merge(shard);
+//   LOG(INFO) << total.Estimate();
+
+#ifndef PUBLIC_BASE_HYPERLOGLOG_H_
+#define PUBLIC_BASE_HYPERLOGLOG_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/hash.h"
+#include "base/string_piece.h"
+
+namespace base {
+
+// Const methods only read the counter, so they can run concurrently with
+// each other; changing it needs exclusive access.
+class HyperLogLog {
+ public:
+  static const int kMinPrecision = 4;
+  static const int kMaxPrecision = 18;
+  static const int kDefaultPrecision = 14;
+
+  explicit HyperLogLog(int precision = kDefaultPrecision);
+
+  // Keys are hashed with Fingerprint(); AddFingerprint() takes a
+  // fingerprint computed by the caller.
+  void Add(const StringPiece& key) { AddFingerprint(Fingerprint(key)); }
+  void AddFingerprint(uint64 fp);
+
+  // The estimated number of distinct keys added.
+  uint64 Estimate() const;
+
+  // Adds the keys of |other|, which must have the same precision. Returns
+  // false, changing nothing, if it has not.
+  bool Merge(const HyperLogLog& other);
+
+  void Clear();
+
+  int precision() const { return precision_; }
+  bool is_sparse() const { return registers_.empty(); }
+
+  // Appends the counter to |out|, in a format independent of byte order.
+  void SerializeTo(std::string* out) const;
+
+  // Replaces the counter with one written by SerializeTo(). Returns false,
+  // leaving the counter unchanged, if |data| is not such a counter.
+  bool Deserialize(const StringPiece& data);
+
+ private:
+  // Sparse entries are (index << 6) | rank at kSparsePrecision.
+  static const int kSparsePrecision = 25;
+
+  // The most sparse entries kept: four bytes per entry against one per
+  // register.
+  size_t MaxSparseSize() const {
+    return (static_cast<size_t>(1) << precision_) / 4;
+  }
+
+  // Sorts the pending sparse entries into |sparse_|, keeping the highest
+  // rank per index, and switches to dense registers if they take less room.
+  void FlushSparse();
+  void ToDense();
+
+  // The sparse entries with the pending ones merged in, as FlushSparse()
+  // would leave them, without changing the counter: |sparse_| itself if
+  // nothing is pending, else |*scratch|. May be longer than
+  // MaxSparseSize(), where a flush would have switched to dense.
+  const std::vector<uint32>& FlushedSparse(
+      std::vector<uint32>* scratch) const;
+  void SparseToRegisters(const std::vector<uint32>& sparse,
+                         std::vector<uint8>* registers) const;
+  void AddSparseToRegisters(uint32 entry, uint8* registers) const;
+
+  int precision_;
+  // Only one representation is in use: sparse while |registers_| is empty.
+  // Added keys are queued in |pending_| and sorted in by batches; const
+  // methods merge the queue into a copy, so they never write the counter.
+  std::vector<uint32> sparse_;    // Sorted, one entry per index.
+  std::vector<uint32> pending_;   // Unsorted, may repeat.
+  std::vector<uint8> registers_;  // 2^precision_ ranks.
+};
+
+}  // namespace base
+
+#endif  // PUBLIC_BASE_HYPERLOGLOG_H_
@@ -0,0 +1,225 @@
+#include "base/log_flight_recorder.h"
+
+#include <execinfo.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+#include "base/debug_util.h"
+#include "base/eintr_wrapper.h"
+
+namespace {
+
+const char kRecorderMagic[8] = { 'L', 'O', 'G', 'F', 'R', 'E', 'C', '1' };
+
+// Layout of the ring, at the start of the mapping. The data area of
+// |capacity| bytes follows the header directly.
+struct RecorderHeader {
+  char magic[8];
+  uint64 capacity;
+  // Total number of bytes ever reserved. Byte n of the stream lives at
+  // data[n % capacity].
+  volatile uint64 head;
+  char padding[40];
+};
+
+COMPILE_ASSERT(sizeof(RecorderHeader) == 64, recorder_header_size);
+
+RecorderHeader* recorder = NULL;
+volatile int crash_dumped = 0;
+
+const int kCrashSignals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+
+inline char* RecorderData(const RecorderHeader* header) {
+  return reinterpret_cast<char*>(const_cast<RecorderHeader*>(header) + 1);
+}
+
+// Async signal safe.
+void WriteToFd(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t rv = HANDLE_EINTR(write(fd, data, len));
+    if (rv <= 0)
+      return;  // Nothing we can do now.
+    data += rv;
+    len -= rv;
+  }
+}
+
+// Writes the ring of |header| to |fd|, oldest record first. When the ring
+// has wrapped, the partially overwritten oldest record is skipped. Async
+// signal safe.
+void DumpRing(const RecorderHeader* header, int fd) {
+  const uint64 capacity = header->capacity;
+  const uint64 head = header->head;
+  const char* data = RecorderData(header);
+
+  uint64 start = 0;
+  if (head > capacity) {
+    start = head - capacity;
+    while (start < head && data[start % capacity] != '\n')
+      ++start;
+    ++start;
+  }
+  if (start >= head)
+    return;
+
+  const uint64 begin = start % capacity;
+  const uint64 len = head - start;
+  const uint64 first = std::min(len, capacity - begin);
+  WriteToFd(fd, data + begin, first);
+  WriteToFd(fd, data, len - first);
+}
+
+void CrashSignalHandler(int signo) {
+  logging::DumpLogFlightRecorderOnCrash();
+
+  static const char kTraceBanner[] = "*** Stack trace:\n";
+  WriteToFd(STDERR_FILENO, kTraceBanner, sizeof(kTraceBanner) - 1);
+  StackTrace trace;
+  size_t count = 0;
+  const void* const* addresses = trace.Addresses(&count);
+  if (addresses) {
+    backtrace_symbols_fd(const_cast<void* const*>(addresses), count,
+                         STDERR_FILENO);
+  }
+
+  signal(signo, SIG_DFL);
+  raise(signo);
+}
+
+}  // namespace
+
+namespace logging {
+
+bool InitLogFlightRecorder(const char* path, size_t capacity) {
+  if (recorder || capacity == 0)
+    return false;
+
+  const size_t size = sizeof(RecorderHeader) + capacity;
+  void* mapping = MAP_FAILED;
+  if (path == NULL) {
+    mapping = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  } else {
+    // Keep the log of the previous run if it left one.
+    int old_fd = open(path, O_RDONLY);
+    if (old_fd >= 0) {
+      char magic[sizeof(kRecorderMagic)];
+      bool is_recorder =
+          HANDLE_EINTR(read(old_fd, magic, sizeof(magic))) ==
+              static_cast<ssize_t>(sizeof(magic)) &&
+          memcmp(magic, kRecorderMagic, sizeof(magic)) == 0;
+      close(old_fd);
+      if (is_recorder)
+        rename(path, (std::string(path) + ".prev").c_str());
+    }
+
+    int fd = HANDLE_EINTR(open(path, O_RDWR | O_CREAT | O_TRUNC, 0644));
+    if (fd < 0)
+      return false;
+    if (ftruncate(fd, size) == 0) {
+      mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+  }
+  if (mapping == MAP_FAILED)
+    return false;
+
+  RecorderHeader* header = static_cast<RecorderHeader*>(mapping);
+  memset(header, 0, sizeof(*header));
+  header->capacity = capacity;
+  header->head = 0;
+  // Written last, so a reader never sees the magic with a bad capacity.
+  __sync_synchronize();
+  memcpy(header->magic, kRecorderMagic, sizeof(kRecorderMagic));
+
+  __sync_synchronize();
+  recorder = header;
+  return true;
+}
+
+bool LogFlightRecorderEnabled() {
+  return recorder != NULL;
+}
+
+void WriteToLogFlightRecorder(const char* data, size_t len) {
+  RecorderHeader* header = recorder;
+  if (header == NULL || len == 0)
+    return;
+
+  const uint64 capacity = header->capacity;
+  if (len > capacity)
+    len = capacity;
+  const uint64 pos = __sync_fetch_and_add(&header->head,
+                                          static_cast<uint64>(len));
+  char* ring = RecorderData(header);
+  const uint64 begin = pos % capacity;
+  const uint64 first = std::min<uint64>(len, capacity - begin);
+  memcpy(ring + begin, data, first);
+  memcpy(ring, data + first, len - first);
+}
+
+void DumpLogFlightRecorder(int fd) {
+  if (recorder)
+    DumpRing(recorder, fd);
+}
+
+void DumpLogFlightRecorderOnCrash() {
+  if (recorder == NULL || __sync_lock_test_and_set(&crash_dumped, 1))
+    return;
+
+  static const char kBegin[] = "*** Log flight recorder, oldest first:\n";
+  static const char kEnd[] = "*** End of log flight recorder\n";
+  WriteToFd(STDERR_FILENO, kBegin, sizeof(kBegin) - 1);
+  DumpRing(recorder, STDERR_FILENO);
+  WriteToFd(STDERR_FILENO, kEnd, sizeof(kEnd) - 1);
+}
+
+void InstallLogFlightRecorderCrashHandler() {
+  // backtrace() loads libgcc on first use, which is not safe in a signal
+  // handler, so do that now.
+  StackTrace warm_up;
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = &CrashSignalHandler;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESETHAND | SA_ONSTACK;
+  for (size_t i = 0; i < arraysize(kCrashSignals); ++i)
+    sigaction(kCrashSignals[i], &action, NULL);
+}
+
+bool DumpLogFlightRecorderFile(const char* path, int fd) {
+  int file = HANDLE_EINTR(open(path, O_RDONLY));
+  if (file < 0)
+    return false;
+
+  struct stat st;
+  void* mapping = MAP_FAILED;
+  if (fstat(file, &st) == 0 &&
+      st.st_size >= static_cast<off_t>(sizeof(RecorderHeader))) {
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, file, 0);
+  }
+  close(file);
+  if (mapping == MAP_FAILED)
+    return false;
+
+  const RecorderHeader* header = static_cast<RecorderHeader*>(mapping);
+  const bool valid =
+      memcmp(header->magic, kRecorderMagic, sizeof(kRecorderMagic)) == 0 &&
+      header->capacity > 0 &&
+      header->capacity == st.st_size - sizeof(RecorderHeader);
+  if (valid)
+    DumpRing(header, fd);
+  munmap(mapping, st.st_size);
+  return valid;
+}
+
+}  // namespace logging
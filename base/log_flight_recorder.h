@@ -0,0 +1,54 @@
+// Description : A flight recorder for LOG() output. Every formatted log
+//               record, whatever its severity and whether or not it passed
+//               the min log level and filters, is appended to a fixed size
+//               ring buffer. The ring is dumped to stderr when the process
+//               crashes or hits LOG(FATAL). When it is backed by a file, the
+//               file can also be read after the process died.
+//
+// Usage:
+//   logging::InitLogFlightRecorder("/var/run/myserver.flight", 8 << 20);
+//   logging::InstallLogFlightRecorderCrashHandler();
+//
+//   // After a crash, from another process:
+//   logging::DumpLogFlightRecorderFile("/var/run/myserver.flight",
+//                                      STDOUT_FILENO);
+
+#ifndef PUBLIC_BASE_LOG_FLIGHT_RECORDER_H_
+#define PUBLIC_BASE_LOG_FLIGHT_RECORDER_H_
+
+#include "base/basictypes.h"
+
+namespace logging {
+
+// Starts recording into a ring of |capacity| bytes. If |path| is NULL the
+// ring lives in anonymous memory, otherwise in a shared mapping of |path|.
+// A valid recorder file already at |path| is first renamed to
+// "<path>.prev" so the log of a previous crash is not overwritten. Returns
+// false on failure. May be called only once, before other threads log.
+bool InitLogFlightRecorder(const char* path, size_t capacity);
+
+// True once InitLogFlightRecorder() succeeded.
+bool LogFlightRecorderEnabled();
+
+// Appends one record. Lock free; records are written concurrently into
+// disjoint slots of the ring.
+void WriteToLogFlightRecorder(const char* data, size_t len);
+
+// Writes the recorded records, oldest first, to |fd|. Async signal safe.
+// Only the first call of DumpLogFlightRecorderOnCrash() in the process
+// produces output, so a LOG(FATAL) that ends in abort() is dumped once.
+void DumpLogFlightRecorder(int fd);
+void DumpLogFlightRecorderOnCrash();
+
+// Installs handlers for SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT that
+// dump the recorder and a stack trace to stderr, then re-raise the signal
+// with the default action.
+void InstallLogFlightRecorderCrashHandler();
+
+// Writes the records of the recorder file at |path| to |fd|. Returns false
+// if |path| is not a recorder file.
+bool DumpLogFlightRecorderFile(const char* path, int fd);
+
+}  // namespace logging
+
+#endif  // PUBLIC_BASE_LOG_FLIGHT_RECORDER_H_
@@ -0,0 +1,500 @@
+#include "base/log_sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+
+#include "base/eintr_wrapper.h"
+#include "base/thread.h"
+
+namespace {
+
+using logging::LogFormat;
+using logging::LogRecord;
+using logging::LogSeverity;
+using logging::LogSink;
+
+// A record waiting for an asynchronous sink. |file| points to a string
+// literal, so it outlives the LogMessage.
+struct QueuedRecord {
+  LogSeverity severity;
+  const char* file;
+  int line;
+  int32 thread_id;
+  int64 timestamp_us;
+  std::string text;
+  // Where the message lies in |text|, or npos if it is not in it, as with
+  // --log_json, and is copied to |message| instead.
+  size_t message_start;
+  size_t message_size;
+  std::string message;
+  bool has_context;
+  logging::LogContext context;
+};
+
+struct SinkEntry {
+  LogSink* sink;
+  LogSeverity min_severity;
+  LogFormat format;
+  bool async;
+  size_t max_pending;
+  volatile uint64 dropped;
+
+  // Guarded by the queue mutex of the router.
+  std::deque<QueuedRecord> pending;
+  bool busy;  // The dispatcher is delivering a batch to |sink|.
+};
+
+// Set while a sink runs, so that what it logs is not routed to sinks again.
+thread_local bool in_log_sink = false;
+
+void WriteToFd(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t rv = HANDLE_EINTR(write(fd, data, len));
+    if (rv <= 0)
+      return;
+    data += rv;
+    len -= rv;
+  }
+}
+
+int64 MonotonicMillis() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Holds the sinks and delivers to the asynchronous ones from its thread.
+class LogSinkRouter : public base::Thread {
+ public:
+  LogSinkRouter()
+      : base::Thread(false),
+        queue_cond_(&queue_mutex_),
+        idle_cond_(&queue_mutex_),
+        next_async_(0),
+        started_dispatcher_(false) {}
+
+  bool Add(LogSink* sink, LogSeverity min_severity, LogFormat format,
+           bool async, size_t max_pending);
+  bool Remove(LogSink* sink);
+  uint64 DropCount(const LogSink* sink);
+  // Waits at most |timeout_ms| for the queues to drain, forever if
+  // negative. Returns false if it gave up.
+  bool Flush(int timeout_ms);
+  void Send(const LogRecord& record);
+
+ protected:
+  virtual void Run();
+
+ private:
+  // Returns the next asynchronous sink with queued records, NULL if there
+  // is none. Must be called with |queue_mutex_| held.
+  SinkEntry* NextPendingEntry();
+
+  // Guards |sinks_|. Synchronous sinks are called with a reader lock held.
+  base::RwMutex sinks_mutex_;
+  std::vector<SinkEntry*> sinks_;
+
+  base::Mutex queue_mutex_;
+  base::CondVar queue_cond_;  // Signaled when a record is queued.
+  base::CondVar idle_cond_;   // Signaled when a batch was delivered.
+  std::vector<SinkEntry*> async_sinks_;
+  size_t next_async_;
+  bool started_dispatcher_;
+
+  DISALLOW_COPY_AND_ASSIGN(LogSinkRouter);
+};
+
+static pthread_mutex_t router_mutex = PTHREAD_MUTEX_INITIALIZER;
+LogSinkRouter* router = NULL;
+volatile int sink_count = 0;
+
+LogSinkRouter* GetRouter() {
+  GLOBAL_MUTEX_LOCK(router_mutex);
+  if (!router)
+    router = new LogSinkRouter();
+  GLOBAL_MUTEX_UNLOCK(router_mutex);
+  return router;
+}
+
+bool LogSinkRouter::Add(LogSink* sink, LogSeverity min_severity,
+                        LogFormat format, bool async, size_t max_pending) {
+  base::WriterMutexLock lock(&sinks_mutex_);
+  for (size_t i = 0; i < sinks_.size(); ++i) {
+    if (sinks_[i]->sink == sink)
+      return false;
+  }
+
+  SinkEntry* entry = new SinkEntry;
+  entry->sink = sink;
+  entry->min_severity = min_severity;
+  entry->format = format;
+  entry->async = async;
+  entry->max_pending = std::max<size_t>(max_pending, 1);
+  entry->dropped = 0;
+  entry->busy = false;
+  sinks_.push_back(entry);
+  __sync_fetch_and_add(&sink_count, 1);
+
+  if (async) {
+    base::MutexLock queue_lock(&queue_mutex_);
+    async_sinks_.push_back(entry);
+    if (!started_dispatcher_) {
+      started_dispatcher_ = true;
+      Start();
+    }
+  }
+  return true;
+}
+
+bool LogSinkRouter::Remove(LogSink* sink) {
+  SinkEntry* entry = NULL;
+  {
+    base::WriterMutexLock lock(&sinks_mutex_);
+    for (size_t i = 0; i < sinks_.size(); ++i) {
+      if (sinks_[i]->sink == sink) {
+        entry = sinks_[i];
+        sinks_.erase(sinks_.begin() + i);
+        __sync_fetch_and_sub(&sink_count, 1);
+        break;
+      }
+    }
+  }
+  if (!entry)
+    return false;
+
+  if (entry->async) {
+    base::MutexLock queue_lock(&queue_mutex_);
+    async_sinks_.erase(std::find(async_sinks_.begin(), async_sinks_.end(),
+                                 entry));
+    while (entry->busy)
+      idle_cond_.Wait();
+  }
+  delete entry;
+  return true;
+}
+
+uint64 LogSinkRouter::DropCount(const LogSink* sink) {
+  base::ReaderMutexLock lock(&sinks_mutex_);
+  for (size_t i = 0; i < sinks_.size(); ++i) {
+    if (sinks_[i]->sink == sink)
+      return sinks_[i]->dropped;
+  }
+  return 0;
+}
+
+bool LogSinkRouter::Flush(int timeout_ms) {
+  const int64 deadline_ms = MonotonicMillis() + timeout_ms;
+  bool drained = true;
+  {
+    base::MutexLock queue_lock(&queue_mutex_);
+    while (true) {
+      bool idle = true;
+      for (size_t i = 0; i < async_sinks_.size() && idle; ++i)
+        idle = async_sinks_[i]->pending.empty() && !async_sinks_[i]->busy;
+      if (idle)
+        break;
+      if (timeout_ms < 0) {
+        idle_cond_.Wait();
+        continue;
+      }
+      const int64 remaining_ms = deadline_ms - MonotonicMillis();
+      if (remaining_ms <= 0) {
+        drained = false;
+        break;
+      }
+      idle_cond_.WaitWithTimeout(static_cast<int>(remaining_ms));
+    }
+  }
+
+  // Asynchronous sinks were flushed by the dispatcher after their last
+  // batch.
+  base::ReaderMutexLock lock(&sinks_mutex_);
+  for (size_t i = 0; i < sinks_.size(); ++i) {
+    if (!sinks_[i]->async)
+      sinks_[i]->sink->Flush();
+  }
+  return drained;
+}
+
+void LogSinkRouter::Send(const LogRecord& record) {
+  std::string formatted;
+  base::ReaderMutexLock lock(&sinks_mutex_);
+  for (size_t i = 0; i < sinks_.size(); ++i) {
+    SinkEntry* entry = sinks_[i];
+    if (record.severity < entry->min_severity)
+      continue;
+
+    if (!entry->async) {
+      formatted.clear();
+      logging::FormatLogRecord(record, entry->format, &formatted);
+      entry->sink->Send(record, formatted);
+      continue;
+    }
+
+    // Checked first, so records dropped from a full queue cost no copy.
+    base::MutexLock queue_lock(&queue_mutex_);
+    if (entry->pending.size() >= entry->max_pending) {
+      __sync_fetch_and_add(&entry->dropped, 1);
+      continue;
+    }
+    entry->pending.emplace_back();
+    QueuedRecord& queued = entry->pending.back();
+    queued.severity = record.severity;
+    queued.file = record.file;
+    queued.line = record.line;
+    queued.thread_id = record.thread_id;
+    queued.timestamp_us = record.timestamp_us;
+    queued.text.assign(record.text.data(), record.text.size());
+    const std::less_equal<const char*> not_after;
+    if (not_after(record.text.data(), record.message.data()) &&
+        not_after(record.message.data() + record.message.size(),
+                  record.text.data() + record.text.size())) {
+      queued.message_start = record.message.data() - record.text.data();
+      queued.message_size = record.message.size();
+    } else {
+      queued.message_start = std::string::npos;
+      queued.message.assign(record.message.data(), record.message.size());
+    }
+    queued.has_context = record.context != NULL;
+    if (record.context)
+      queued.context = *record.context;
+    else
+      queued.context.Clear();  // Copying reads the number of fields.
+    queue_cond_.Signal();
+  }
+}
+
+SinkEntry* LogSinkRouter::NextPendingEntry() {
+  for (size_t i = 0; i < async_sinks_.size(); ++i) {
+    SinkEntry* entry = async_sinks_[(next_async_ + i) % async_sinks_.size()];
+    if (!entry->pending.empty()) {
+      // Start after this sink next time, so a busy sink does not starve
+      // the others.
+      next_async_ = (next_async_ + i + 1) % async_sinks_.size();
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+void LogSinkRouter::Run() {
+  in_log_sink = true;
+  std::deque<QueuedRecord> batch;
+  std::string formatted;
+  while (true) {
+    SinkEntry* entry = NULL;
+    {
+      base::MutexLock queue_lock(&queue_mutex_);
+      while ((entry = NextPendingEntry()) == NULL)
+        queue_cond_.Wait();
+      batch.swap(entry->pending);
+      entry->busy = true;
+    }
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+      const QueuedRecord& queued = batch[i];
+      LogRecord record;
+      record.severity = queued.severity;
+      record.file = queued.file;
+      record.line = queued.line;
+      record.thread_id = queued.thread_id;
+      record.timestamp_us = queued.timestamp_us;
+      record.text = queued.text;
+      if (queued.message_start == std::string::npos) {
+        record.message = queued.message;
+      } else {
+        record.message = record.text.substr(queued.message_start,
+                                            queued.message_size);
+      }
+      record.context = queued.has_context ? &queued.context : NULL;
+      formatted.clear();
+      logging::FormatLogRecord(record, entry->format, &formatted);
+      entry->sink->Send(record, formatted);
+    }
+    entry->sink->Flush();
+    batch.clear();
+
+    base::MutexLock queue_lock(&queue_mutex_);
+    entry->busy = false;
+    idle_cond_.SignalAll();
+  }
+}
+
+// {"time":"2026-01-02T03:04:05.678901Z","severity":"INFO","file":"a.cc",
+//  "line":12,"tid":345,<context members>,"message":"..."}
+void AppendJsonLogLine(const LogRecord& record, std::string* out) {
+  const time_t seconds = record.timestamp_us / 1000000;
+  struct tm tm_time = {0};
+  gmtime_r(&seconds, &tm_time);
+  char buffer[96];
+  int len = snprintf(buffer, sizeof(buffer),
+                     "{\"time\":\"%04d-%02d-%02dT%02d:%02d:%02d.%06dZ\","
+                     "\"severity\":\"%s\",\"file\":",
+                     1900 + tm_time.tm_year, 1 + tm_time.tm_mon,
+                     tm_time.tm_mday, tm_time.tm_hour, tm_time.tm_min,
+                     tm_time.tm_sec,
+                     static_cast<int>(record.timestamp_us % 1000000),
+                     logging::LogSeverityName(record.severity));
+  out->append(buffer, len);
+  logging::AppendJsonString(record.file, out);
+  len = snprintf(buffer, sizeof(buffer), ",\"line\":%d,\"tid\":%d",
+                 record.line, record.thread_id);
+  out->append(buffer, len);
+
+  if (record.context && record.context->business_id() != 0 &&
+      FLAGS_enable_addition_info_business_id) {
+    len = snprintf(buffer, sizeof(buffer), ",\"business_id\":%llu",
+                   static_cast<unsigned long long>(
+                       record.context->business_id()));
+    out->append(buffer, len);
+  }
+  if (record.context && !record.context->empty())
+    record.context->AppendJsonMembers(out);
+
+  out->append(",\"message\":", 11);
+  base::StringPiece message = record.message;
+  if (message.ends_with("\n"))
+    message.remove_suffix(1);
+  logging::AppendJsonString(message, out);
+  out->append("}\n", 2);
+}
+
+}  // namespace
+
+namespace logging {
+
+void FormatLogRecord(const LogRecord& record, LogFormat format,
+                     std::string* out) {
+  switch (format) {
+    case LOG_FORMAT_TEXT:
+      record.text.AppendToString(out);
+      break;
+    case LOG_FORMAT_MESSAGE:
+      record.message.AppendToString(out);
+      break;
+    case LOG_FORMAT_JSON:
+      AppendJsonLogLine(record, out);
+      break;
+  }
+}
+
+bool AddLogSink(LogSink* sink, LogSeverity min_severity, LogFormat format,
+                bool async, size_t max_pending) {
+  return GetRouter()->Add(sink, min_severity, format, async, max_pending);
+}
+
+bool RemoveLogSink(LogSink* sink) {
+  return GetRouter()->Remove(sink);
+}
+
+uint64 GetLogSinkDropCount(const LogSink* sink) {
+  return GetRouter()->DropCount(sink);
+}
+
+void FlushLogSinks() {
+  FlushLogSinksWithTimeout(-1);
+}
+
+bool FlushLogSinksWithTimeout(int timeout_ms) {
+  // The dispatcher would wait for itself.
+  if (in_log_sink)
+    return false;
+  FlushSuppressedRepeats();
+  if (!HasLogSinks())
+    return true;
+  return GetRouter()->Flush(timeout_ms);
+}
+
+bool HasLogSinks() {
+  return sink_count > 0;
+}
+
+void SendToLogSinks(const LogRecord& record) {
+  if (in_log_sink || !HasLogSinks())
+    return;
+  in_log_sink = true;
+  GetRouter()->Send(record);
+  in_log_sink = false;
+}
+
+void StderrLogSink::Send(const LogRecord& record,
+                         const base::StringPiece& formatted) {
+  WriteToFd(STDERR_FILENO, formatted.data(), formatted.size());
+}
+
+FileLogSink::FileLogSink(const std::string& path)
+    : fd_(HANDLE_EINTR(open(path.c_str(),
+                            O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                            0644))) {
+}
+
+FileLogSink::~FileLogSink() {
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+void FileLogSink::Send(const LogRecord& record,
+                       const base::StringPiece& formatted) {
+  if (fd_ >= 0)
+    WriteToFd(fd_, formatted.data(), formatted.size());
+}
+
+UnixSocketLogSink::UnixSocketLogSink(const std::string& path)
+    : path_(path),
+      fd_(socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)),
+      send_failures_(0) {
+}
+
+UnixSocketLogSink::~UnixSocketLogSink() {
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+void UnixSocketLogSink::Send(const LogRecord& record,
+                             const base::StringPiece& formatted) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (fd_ < 0 || path_.size() >= sizeof(addr.sun_path)) {
+    __sync_fetch_and_add(&send_failures_, 1);
+    return;
+  }
+  memcpy(addr.sun_path, path_.data(), path_.size());
+
+  // The socket is not connected, so a restarted collector is picked up by
+  // the next record.
+  ssize_t rv = HANDLE_EINTR(sendto(fd_, formatted.data(), formatted.size(),
+                                   MSG_DONTWAIT | MSG_NOSIGNAL,
+                                   reinterpret_cast<struct sockaddr*>(&addr),
+                                   sizeof(addr)));
+  if (rv != static_cast<ssize_t>(formatted.size()))
+    __sync_fetch_and_add(&send_failures_, 1);
+}
+
+MemoryLogSink::MemoryLogSink(size_t max_records)
+    : max_records_(std::max<size_t>(max_records, 1)) {
+}
+
+void MemoryLogSink::GetRecords(std::vector<std::string>* records) const {
+  base::MutexLock lock(&mutex_);
+  records->assign(records_.begin(), records_.end());
+}
+
+void MemoryLogSink::Send(const LogRecord& record,
+                         const base::StringPiece& formatted) {
+  base::MutexLock lock(&mutex_);
+  if (records_.size() >= max_records_)
+    records_.pop_front();
+  records_.push_back(formatted.as_string());
+}
+
+}  // namespace logging
@@ -0,0 +1,179 @@
+// Description : Routes LOG() output to any number of sinks in addition to
+//               the log file and stderr. Each sink has its own minimum
+//               severity and format. A sink is either called synchronously
+//               on the logging thread, or asynchronously from a shared
+//               dispatcher thread through a bounded per-sink queue, so a slow
+//               sink never blocks callers; records that do not fit in the
+//               queue are dropped and counted.
+//
+// Usage:
+//   logging::UnixSocketLogSink collector("/var/run/logcollector.sock");
+//   logging::AddLogSink(&collector, logging::LOG_WARNING,
+//                       logging::LOG_FORMAT_TEXT, true);
+//   ...
+//   logging::RemoveLogSink(&collector);
+//
+// Sinks only see records that pass the min log level, the log message
+// handler and the log filter prefix.
+
+#ifndef PUBLIC_BASE_LOG_SINK_H_
+#define PUBLIC_BASE_LOG_SINK_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "base/mutex.h"
+#include "base/string_piece.h"
+
+namespace logging {
+
+// How a log record is laid out for a sink.
+enum LogFormat {
+  // The usual "[tid:MMDD/HHMMSS:SEVERITY:file(line)] message" line.
+  LOG_FORMAT_TEXT,
+  // The message alone, without the prefix.
+  LOG_FORMAT_MESSAGE,
+  // One JSON object per line, see --log_json in base/logging.h.
+  LOG_FORMAT_JSON,
+};
+
+// A log record as built by LogMessage. The pieces point into the LogMessage
+// and are only valid during the call they are passed to.
+struct LogRecord {
+  LogSeverity severity;
+  const char* file;
+  int line;
+  int32 thread_id;
+  int64 timestamp_us;         // Wall clock time, microseconds since the epoch.
+  base::StringPiece text;     // The whole line as written to the log file,
+                              // with its trailing newline.
+  base::StringPiece message;  // The message past the prefix, with its
+                              // trailing newline.
+  const LogContext* context;  // The context of the logging thread, NULL if
+                              // it was empty.
+};
+
+// Appends |record| laid out as |format| to |out|.
+void FormatLogRecord(const LogRecord& record, LogFormat format,
+                     std::string* out);
+
+class LogSink {
+ public:
+  virtual ~LogSink() {}
+
+  // Receives one record, and the record laid out in the format the sink was
+  // added with. Sinks may log; what they log is not routed to sinks again.
+  virtual void Send(const LogRecord& record,
+                    const base::StringPiece& formatted) = 0;
+
+  // Called after each batch delivered by the dispatcher thread and by
+  // FlushLogSinks().
+  virtual void Flush() {}
+};
+
+// Starts routing records of at least |min_severity| to |sink|. If |async|,
+// records are queued and delivered from the dispatcher thread; at most
+// |max_pending| records wait for the sink and newer ones are dropped. The
+// caller keeps ownership of |sink|, which must stay alive until
+// RemoveLogSink() returns. Returns false if |sink| was already added.
+bool AddLogSink(LogSink* sink, LogSeverity min_severity, LogFormat format,
+                bool async, size_t max_pending = 10000);
+
+// Stops routing records to |sink| and discards its queued records. Once it
+// returns, |sink| is not called anymore and can be deleted. Must not be
+// called from a sink. Returns false if |sink| was not added.
+bool RemoveLogSink(LogSink* sink);
+
+// Returns the number of records dropped for |sink| because its queue was
+// full, 0 if |sink| was not added.
+uint64 GetLogSinkDropCount(const LogSink* sink);
+
+// Waits until the queued records were delivered, then flushes every sink.
+void FlushLogSinks();
+// The same, but waits at most |timeout_ms| for the queued records, so a
+// hung sink cannot keep LOG(FATAL), which calls it, from crashing. Returns
+// false if records were still queued.
+bool FlushLogSinksWithTimeout(int timeout_ms);
+
+// Called by LogMessage for every record that passed the filters.
+bool HasLogSinks();
+void SendToLogSinks(const LogRecord& record);
+
+// Writes to stderr.
+class StderrLogSink : public LogSink {
+ public:
+  StderrLogSink() {}
+  virtual void Send(const LogRecord& record,
+                    const base::StringPiece& formatted);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(StderrLogSink);
+};
+
+// Appends to a file with a single write() per record. The file is opened
+// with O_APPEND, so records of several processes sharing it do not
+// interleave.
+class FileLogSink : public LogSink {
+ public:
+  explicit FileLogSink(const std::string& path);
+  virtual ~FileLogSink();
+
+  // False if the file could not be opened; records are then dropped.
+  bool is_open() const { return fd_ >= 0; }
+
+  virtual void Send(const LogRecord& record,
+                    const base::StringPiece& formatted);
+
+ private:
+  int fd_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileLogSink);
+};
+
+// Sends each record as one datagram to a local collector listening on a
+// SOCK_DGRAM Unix socket at |path|. Never blocks: records are dropped while
+// the collector is down or behind, and counted in send_failures().
+class UnixSocketLogSink : public LogSink {
+ public:
+  explicit UnixSocketLogSink(const std::string& path);
+  virtual ~UnixSocketLogSink();
+
+  uint64 send_failures() const { return send_failures_; }
+
+  virtual void Send(const LogRecord& record,
+                    const base::StringPiece& formatted);
+
+ private:
+  const std::string path_;
+  int fd_;
+  volatile uint64 send_failures_;
+
+  DISALLOW_COPY_AND_ASSIGN(UnixSocketLogSink);
+};
+
+// Keeps the last |max_records| records in memory, e.g. to show them on a
+// status page.
+class MemoryLogSink : public LogSink {
+ public:
+  explicit MemoryLogSink(size_t max_records);
+
+  // Replaces |records| with the kept records, oldest first.
+  void GetRecords(std::vector<std::string>* records) const;
+
+  virtual void Send(const LogRecord& record,
+                    const base::StringPiece& formatted);
+
+ private:
+  const size_t max_records_;
+  mutable base::Mutex mutex_;
+  std::deque<std::string> records_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryLogSink);
+};
+
+}  // namespace logging
+
+#endif  // PUBLIC_BASE_LOG_SINK_H_
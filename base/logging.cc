@@ -4,7 +4,12 @@
 
 #include "base/logging.h"
 
+#include <sys/stat.h>
 #include <sys/syscall.h>
+#include <sys/time.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <time.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -20,18 +25,58 @@ typedef pthread_mutex_t* MutexHandle;
 #include <iomanip>
 #include <cstring>
 #include <algorithm>
+#include <deque>
+#include <vector>
 
+#include "base/aho_corasick.h"
+#include "base/block_compress.h"
 #include "base/debug_util.h"
 #include "base/eintr_wrapper.h"
+#include "base/hash.h"
+#include "base/log_flight_recorder.h"
+#include "base/log_sink.h"
 #include "base/mutex.h"
 #include "base/safe_strerror_posix.h"
 #include "base/string_piece.h"
 #include "base/string_util.h"
+#include "base/thread.h"
 #include "base/utf_string_conversions.h"
 
 DEFINE_int32(v, -1, "LOG verbose level.");
+DEFINE_string(vmodule, "",
+    "Per module verbose level as <pattern>=<level>[,...]; overrides --v "
+    "for matching files.");
 DEFINE_bool(enable_addition_info_business_id, true,
     "whether enable add business id in log");
+DEFINE_int32(log_rotate_size_mb, 0,
+    "Start a new log file once the current one reaches this many MB. "
+    "0 disables size based rotation.");
+DEFINE_int32(log_rotate_interval_sec, 0,
+    "Start a new log file every this many seconds. "
+    "0 disables time based rotation.");
+DEFINE_int32(log_max_rotated_files, 0,
+    "How many rotated log files to keep. 0 keeps all of them.");
+DEFINE_bool(log_compress_rotated, false,
+    "Compress rotated log files in the background.");
+DEFINE_bool(log_context_json, false,
+    "Write the structured log context as a JSON object instead of "
+    "key=value pairs.");
+DEFINE_bool(log_json, false,
+    "Write log lines as JSON objects, one per line, with the time, "
+    "severity, file, line, thread id, context fields and message.");
+DEFINE_bool(log_suppress_repeats, false,
+    "Drop messages identical to the previous one and log how many were "
+    "dropped instead.");
+
+namespace logging {
+
+bool ValidateVModule(const char* flagname, const std::string& value);
+bool ValidateVerboseLevel(const char* flagname, int32 value);
+
+}  // namespace logging
+
+DEFINE_validator(v, &logging::ValidateVerboseLevel);
+DEFINE_validator(vmodule, &logging::ValidateVModule);
 
 namespace logging {
 
@@ -52,6 +97,11 @@ LoggingDestination logging_destination = LOG_ONLY_TO_SYSTEM_DEBUG_LOG;
 const int kMaxFilteredLogLevel = LOG_WARNING;
 std::string* log_filter_prefix;
 
+// Set by SetLogFilterPatterns(), guarded by log_filter_patterns_lock.
+pthread_rwlock_t log_filter_patterns_lock = PTHREAD_RWLOCK_INITIALIZER;
+base::AhoCorasickMatcher* log_filter_patterns = NULL;
+LogFilterMode log_filter_patterns_mode = LOG_FILTER_DROP_MATCHING;
+
 // For LOG_ERROR and above, always print to stderr.
 const int kAlwaysPrintErrorLevel = LOG_ERROR;
 
@@ -65,6 +115,18 @@ PathString* log_file_name = NULL;
 // this file is lazily opened and the handle may be NULL
 FileHandle log_file = NULL;
 
+// When rotation is enabled, the file actually written is a timestamped
+// sibling of |log_file_name|, which is then a symlink to it.  NULL when
+// rotation is off.
+PathString* current_log_file_path = NULL;
+// Bytes in the current log file; only maintained when rotating.
+int64 log_file_size = 0;
+// When the next time based rotation is due, 0 if none.
+time_t next_log_rotation_time = 0;
+
+// Suffix appended to rotated files once they have been compressed.
+const char kCompressedLogSuffix[] = ".blz";
+
 // what should be prepended to each message?
 bool log_process_id = false;
 bool log_thread_id  = true;
@@ -89,6 +151,35 @@ static base::Mutex* log_lock = NULL;
 // because LockFileEx is not thread safe.
 pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+volatile int32 vlog_generation = 1;
+
+struct VModuleEntry {
+  std::string pattern;
+  bool match_path;  // Pattern contains '/'; match it against the full path.
+  int level;
+};
+
+// Parsed --vmodule, guarded by vmodule_mutex.
+static pthread_mutex_t vmodule_mutex = PTHREAD_MUTEX_INITIALIZER;
+std::vector<VModuleEntry>* vmodule_entries = NULL;
+
+// State of --log_suppress_repeats, updated without a lock: the key of the
+// last message written, its fingerprint with the severity in the low bits,
+// and how many repeats of it were dropped since.
+volatile uint64 last_message_key = 0;
+volatile int32 suppressed_repeats = 0;
+volatile time_t first_repeat_time = 0;
+volatile int32 repeat_summary_timer_started = 0;
+// Set while a summary is being logged, which is not itself a repeat.
+thread_local bool writing_repeat_summary = false;
+
+// A storm of identical messages still lets one through this often, so the
+// log shows that it is ongoing.
+const int kRepeatSummaryIntervalSec = 10;
+
+// How long LOG(FATAL) waits for asynchronous log sinks before crashing.
+const int kFatalSinkFlushTimeoutMs = 3000;
+
 // Helper functions to wrap platform differences.
 
 int32 CurrentProcessId() {
@@ -99,6 +190,12 @@ int32 CurrentThreadId() {
   return syscall(__NR_gettid);
 }
 
+int64 MonotonicMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
 uint64 TickCount() {
   struct timespec ts;
   clock_gettime(CLOCK_MONOTONIC, &ts);
@@ -108,14 +205,390 @@ uint64 TickCount() {
   return absolute_micro;
 }
 
+bool ParseVModule(const std::string& value,
+                  std::vector<VModuleEntry>* entries) {
+  std::vector<std::string> items;
+  SplitString(value, ',', &items);
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (items[i].empty())
+      continue;
+    size_t eq = items[i].rfind('=');
+    VModuleEntry entry;
+    if (eq == std::string::npos || eq == 0 ||
+        !StringToInt(items[i].substr(eq + 1), &entry.level))
+      return false;
+    entry.pattern = items[i].substr(0, eq);
+    entry.match_path = entry.pattern.find('/') != std::string::npos;
+    entries->push_back(entry);
+  }
+  return true;
+}
+
+// Runs whenever --vmodule is set through the flags library.  Installs the
+// new patterns and invalidates every cached VLOG call site.
+bool ValidateVModule(const char* flagname, const std::string& value) {
+  std::vector<VModuleEntry>* entries = new std::vector<VModuleEntry>();
+  if (!ParseVModule(value, entries)) {
+    fprintf(stderr, "Invalid value for --%s: %s\n", flagname, value.c_str());
+    delete entries;
+    return false;
+  }
+
+  GLOBAL_MUTEX_LOCK(vmodule_mutex);
+  std::swap(entries, vmodule_entries);
+  GLOBAL_MUTEX_UNLOCK(vmodule_mutex);
+  delete entries;
+
+  base::AtomicIncrement(&vlog_generation);
+  return true;
+}
+
+bool ValidateVerboseLevel(const char* flagname, int32 value) {
+  base::AtomicIncrement(&vlog_generation);
+  return true;
+}
+
+int ResolveVlogSite(VlogSiteState* site, const char* file) {
+  // Read the generation first: a concurrent change then at worst causes one
+  // more resolution later, never a stale cache.
+  const int32 generation = vlog_generation;
+
+  // Strip the extension, e.g. "base/hash.cc" -> "base/hash".
+  std::string path(file);
+  const char* base_name = strrchr(file, '/');
+  base_name = base_name ? base_name + 1 : file;
+  size_t dot = path.find('.', base_name - file);
+  if (dot != std::string::npos)
+    path.resize(dot);
+  const std::string module(path, base_name - file);
+
+  int level = kVlogUseGlobalLevel;
+  GLOBAL_MUTEX_LOCK(vmodule_mutex);
+  if (vmodule_entries) {
+    for (size_t i = 0; i < vmodule_entries->size(); ++i) {
+      const VModuleEntry& entry = (*vmodule_entries)[i];
+      if (MatchPatternASCII(entry.match_path ? path : module, entry.pattern)) {
+        level = entry.level;
+        break;
+      }
+    }
+  }
+  GLOBAL_MUTEX_UNLOCK(vmodule_mutex);
+
+  site->level = level;
+  // Publish the level before the generation that marks it valid.
+  __sync_synchronize();
+  site->generation = generation;
+  return level == kVlogUseGlobalLevel ? FLAGS_v : level;
+}
+
+// Takes the count of dropped repeats, leaving it zero.
+int32 TakeSuppressedRepeats() {
+  // Read first, so the common case writes nothing.
+  return suppressed_repeats ? __sync_lock_test_and_set(&suppressed_repeats, 0)
+                            : 0;
+}
+
+// Logs the "N repeats suppressed" line of a storm no later message has
+// reported yet. With |only_expired|, only if the storm began at least
+// kRepeatSummaryIntervalSec ago.
+void WriteSuppressedRepeats(bool only_expired) {
+  if (suppressed_repeats == 0 ||
+      (only_expired &&
+       time(NULL) - first_repeat_time < kRepeatSummaryIntervalSec)) {
+    return;
+  }
+  const int32 count = TakeSuppressedRepeats();
+  if (count <= 0)
+    return;
+  writing_repeat_summary = true;
+  LogMessage(__FILE__, __LINE__,
+             static_cast<LogSeverity>(last_message_key & 7)).stream()
+      << count << " repeats suppressed";
+  writing_repeat_summary = false;
+}
+
+void WriteSuppressedRepeatsAtExit() {
+  WriteSuppressedRepeats(false);
+}
+
+// Reports storms that end in a quiet period, which no later message would
+// carry the count of.
+class RepeatSummaryTimer : public base::Thread {
+ public:
+  RepeatSummaryTimer() : base::Thread(false) {}
+
+ protected:
+  virtual void Run() {
+    while (true) {
+      sleep(kRepeatSummaryIntervalSec);
+      WriteSuppressedRepeats(true);
+    }
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(RepeatSummaryTimer);
+};
+
+// Returns false if |message| repeats the previous message and should be
+// dropped.  Otherwise sets |suppressed| to the number of earlier repeats
+// that were dropped.  Counts are approximate when threads log different
+// messages at the same moment.
+bool CheckRepeatedMessage(LogSeverity severity, const base::StringPiece& message,
+                          int* suppressed) {
+  const uint64 key = base::Fingerprint(message) << 3 | severity;
+  const uint64 last = last_message_key;
+  if (key != last) {
+    // A new message: whoever installs its key reports the storm it ends.
+    if (base::AtomicCompareAndSwap(&last_message_key, last, key) == last)
+      *suppressed = TakeSuppressedRepeats();
+    return true;
+  }
+
+  const time_t now = time(NULL);
+  if (base::AtomicIncrement(&suppressed_repeats) == 1) {
+    first_repeat_time = now;
+    if (base::AtomicCompareAndSwap(&repeat_summary_timer_started, 0, 1) ==
+        0) {
+      (new RepeatSummaryTimer())->Start();
+      atexit(&WriteSuppressedRepeatsAtExit);
+    }
+  }
+  if (now - first_repeat_time < kRepeatSummaryIntervalSec)
+    return false;
+  // Let one through per interval, so the log shows that the storm goes on.
+  const int32 count = TakeSuppressedRepeats();
+  *suppressed = count > 0 ? count - 1 : 0;
+  return true;
+}
+
 void CloseFile(FileHandle log) {
   fclose(log);
 }
 
+// Writes |record| to the log file with one write() when possible.  The file
+// is opened with O_APPEND by fopen(..., "a"), so the record lands at the end
+// of the file in one piece even when other processes append to it.
+void WriteToLogFileAtomically(const std::string& record) {
+  const int fd = fileno(log_file);
+  const char* data = record.data();
+  size_t len = record.size();
+  while (len > 0) {
+    ssize_t rv = HANDLE_EINTR(write(fd, data, len));
+    if (rv <= 0)
+      return;  // Nothing we can do now.
+    // Only a full disk or a huge record gets here more than once.
+    data += rv;
+    len -= rv;
+  }
+}
+
 void DeleteFilePath(const PathString& log_name) {
   unlink(log_name.c_str());
 }
 
+bool LogRotationEnabled() {
+  return FLAGS_log_rotate_size_mb > 0 || FLAGS_log_rotate_interval_sec > 0;
+}
+
+// Numbers the rotated files of the process.  Guarded by the log lock.
+int rotated_log_sequence = 0;
+
+// Returns "<log_file_name>.YYYYMMDD-HHMMSS.<pid>.<sequence>", where the
+// zero-padded sequence number grows with every call.  The names of the
+// rotated files of a process thus sort in creation order, and are never
+// used twice, even after retention has deleted their files.  Must be called
+// with the log lock held.
+PathString RotatedLogFileName(time_t when) {
+  struct tm tm_time = {0};
+  localtime_r(&when, &tm_time);
+  return *log_file_name + StringPrintf(".%04d%02d%02d-%02d%02d%02d.%d.%06d",
+                                       1900 + tm_time.tm_year,
+                                       1 + tm_time.tm_mon,
+                                       tm_time.tm_mday,
+                                       tm_time.tm_hour,
+                                       tm_time.tm_min,
+                                       tm_time.tm_sec,
+                                       CurrentProcessId(),
+                                       rotated_log_sequence++);
+}
+
+// Atomically repoints |log_file_name| at |target|.
+void UpdateLogFileSymlink(const PathString& target) {
+  struct stat st;
+  if (lstat(log_file_name->c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+    // A plain log file left by a run without rotation.  Give it a rotated
+    // name instead of silently replacing it with the link.
+    rename(log_file_name->c_str(), RotatedLogFileName(st.st_mtime).c_str());
+  }
+
+  // Link to the basename so the link keeps working if the directory moves.
+  size_t slash = target.rfind('/');
+  PathString link_target =
+      slash == PathString::npos ? target : target.substr(slash + 1);
+  PathString temp_link = *log_file_name + ".link";
+  unlink(temp_link.c_str());
+  if (symlink(link_target.c_str(), temp_link.c_str()) == 0)
+    rename(temp_link.c_str(), log_file_name->c_str());
+}
+
+// Opens a new timestamped log file and points the symlink at it.
+bool OpenRotatingLogFile() {
+  const time_t now = time(NULL);
+  // The name can only exist already if an earlier process had the same pid
+  // within the same second; skip ahead past its files.
+  PathString unique_path;
+  struct stat st;
+  do {
+    unique_path = RotatedLogFileName(now);
+  } while (stat(unique_path.c_str(), &st) == 0 ||
+           stat((unique_path + kCompressedLogSuffix).c_str(), &st) == 0);
+
+  log_file = fopen(unique_path.c_str(), "a");
+  if (log_file == NULL)
+    return false;
+
+  if (!current_log_file_path)
+    current_log_file_path = new PathString();
+  *current_log_file_path = unique_path;
+  log_file_size = 0;
+
+  const int interval = FLAGS_log_rotate_interval_sec;
+  next_log_rotation_time = interval > 0 ? (now / interval + 1) * interval : 0;
+
+  UpdateLogFileSymlink(unique_path);
+  return true;
+}
+
+// Compresses rotated log files and enforces the retention count on a
+// background thread, so the thread that triggers a rotation only pays for
+// opening the next file.
+class RotatedLogCleaner : public base::Thread {
+ public:
+  RotatedLogCleaner() : base::Thread(false), cond_(&mutex_) {}
+
+  // |finished| is the file that was just rotated out, |current| the one
+  // being written now.
+  void Schedule(const PathString& finished, const PathString& current) {
+    base::MutexLock lock(&mutex_);
+    Job job = { finished, current, *log_file_name };
+    jobs_.push_back(job);
+    cond_.Signal();
+  }
+
+ protected:
+  virtual void Run() {
+    while (true) {
+      Job job;
+      {
+        base::MutexLock lock(&mutex_);
+        while (jobs_.empty())
+          cond_.Wait();
+        job = jobs_.front();
+        jobs_.pop_front();
+      }
+
+      if (FLAGS_log_compress_rotated) {
+        PathString compressed = job.finished + kCompressedLogSuffix;
+        struct stat st;
+        if (stat(job.finished.c_str(), &st) == 0 &&
+            base::CompressFile(job.finished, compressed)) {
+          // Keep the original mtime, retention orders files by it.
+          struct timespec times[2] = { st.st_atim, st.st_mtim };
+          utimensat(AT_FDCWD, compressed.c_str(), times, 0);
+          unlink(job.finished.c_str());
+        }
+      }
+      if (FLAGS_log_max_rotated_files > 0)
+        RemoveOldLogFiles(job);
+    }
+  }
+
+ private:
+  struct Job {
+    PathString finished;
+    PathString current;
+    PathString link;
+  };
+
+  // Deletes all but the newest FLAGS_log_max_rotated_files rotated files.
+  static void RemoveOldLogFiles(const Job& job) {
+    size_t slash = job.link.rfind('/');
+    PathString dir = slash == PathString::npos ?
+        PathString(".") : job.link.substr(0, slash);
+    PathString prefix = (slash == PathString::npos ?
+        job.link : job.link.substr(slash + 1)) + ".";
+    size_t current_slash = job.current.rfind('/');
+    PathString current_name = current_slash == PathString::npos ?
+        job.current : job.current.substr(current_slash + 1);
+
+    DIR* d = opendir(dir.c_str());
+    if (d == NULL)
+      return;
+    // (mtime, path) of every rotated file, so they sort oldest first.
+    std::vector<std::pair<std::pair<int64, int64>, PathString> > rotated;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+      const char* name = entry->d_name;
+      // Rotated files continue the prefix with their timestamp.
+      if (strncmp(name, prefix.c_str(), prefix.size()) != 0 ||
+          !isdigit(static_cast<unsigned char>(name[prefix.size()])) ||
+          current_name == name)
+        continue;
+      PathString path = dir + "/" + name;
+      struct stat st;
+      if (lstat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        continue;
+      rotated.push_back(std::make_pair(
+          std::make_pair(static_cast<int64>(st.st_mtim.tv_sec),
+                         static_cast<int64>(st.st_mtim.tv_nsec)),
+          path));
+    }
+    closedir(d);
+
+    const size_t keep = FLAGS_log_max_rotated_files;
+    if (rotated.size() <= keep)
+      return;
+    std::sort(rotated.begin(), rotated.end());
+    for (size_t i = 0; i < rotated.size() - keep; ++i)
+      unlink(rotated[i].second.c_str());
+  }
+
+  base::Mutex mutex_;
+  base::CondVar cond_;
+  std::deque<Job> jobs_;
+
+  DISALLOW_COPY_AND_ASSIGN(RotatedLogCleaner);
+};
+
+RotatedLogCleaner* rotated_log_cleaner = NULL;
+
+// Switches to a new log file if the current one is due for rotation.  Must
+// be called with the log lock held.
+void RotateLogFileIfNeeded() {
+  if (!log_file || !current_log_file_path || !LogRotationEnabled())
+    return;
+
+  const int64 max_size = static_cast<int64>(FLAGS_log_rotate_size_mb) << 20;
+  if (!(max_size > 0 && log_file_size >= max_size) &&
+      !(next_log_rotation_time > 0 && time(NULL) >= next_log_rotation_time))
+    return;
+
+  PathString finished = *current_log_file_path;
+  CloseFile(log_file);
+  log_file = NULL;
+  if (!OpenRotatingLogFile())
+    return;
+
+  if (FLAGS_log_compress_rotated || FLAGS_log_max_rotated_files > 0) {
+    if (!rotated_log_cleaner) {
+      rotated_log_cleaner = new RotatedLogCleaner();
+      rotated_log_cleaner->Start();
+    }
+    rotated_log_cleaner->Schedule(finished, *current_log_file_path);
+  }
+}
+
 // Called by logging functions to ensure that debug_file is initialized
 // and can be used for writing. Returns false if the file could not be
 // initialized. debug_file will be NULL in this case.
@@ -132,6 +605,9 @@ bool InitializeLogFileHandle() {
 
   if (logging_destination == LOG_ONLY_TO_FILE ||
       logging_destination == LOG_TO_BOTH_FILE_AND_SYSTEM_DEBUG_LOG) {
+    if (LogRotationEnabled())
+      return OpenRotatingLogFile();
+
     log_file = fopen(log_file_name->c_str(), "a");
     if (log_file == NULL)
       return false;
@@ -160,6 +636,10 @@ void InitLogging(const PathChar* new_log_file, LoggingDestination logging_dest,
     CloseFile(log_file);
     log_file = NULL;
   }
+  if (current_log_file_path) {
+    delete current_log_file_path;
+    current_log_file_path = NULL;
+  }
 
   lock_log_file = lock_log;
   logging_destination = logging_dest;
@@ -192,6 +672,12 @@ int GetMinLogLevel() {
   return min_log_level;
 }
 
+const char* LogSeverityName(LogSeverity severity) {
+  if (severity < 0 || severity >= LOG_NUM_SEVERITIES)
+    return "UNKNOWN";
+  return log_severity_names[severity];
+}
+
 void SetLogFilterPrefix(const char* filter)  {
   if (log_filter_prefix) {
     delete log_filter_prefix;
@@ -202,6 +688,34 @@ void SetLogFilterPrefix(const char* filter)  {
     log_filter_prefix = new std::string(filter);
 }
 
+void SetLogFilterPatterns(const std::vector<std::string>& patterns,
+                          LogFilterMode mode, bool ignore_case) {
+  base::AhoCorasickMatcher* matcher = NULL;
+  if (!patterns.empty())
+    matcher = new base::AhoCorasickMatcher(patterns, ignore_case);
+
+  pthread_rwlock_wrlock(&log_filter_patterns_lock);
+  base::AhoCorasickMatcher* old_matcher = log_filter_patterns;
+  log_filter_patterns = matcher;
+  log_filter_patterns_mode = mode;
+  pthread_rwlock_unlock(&log_filter_patterns_lock);
+  delete old_matcher;
+}
+
+// Returns false if |message| is dropped by SetLogFilterPatterns().
+bool PassesLogFilterPatterns(const base::StringPiece& message) {
+  if (!log_filter_patterns)
+    return true;
+  pthread_rwlock_rdlock(&log_filter_patterns_lock);
+  bool pass = true;
+  if (log_filter_patterns) {
+    pass = log_filter_patterns->Contains(message) ==
+           (log_filter_patterns_mode == LOG_FILTER_KEEP_MATCHING);
+  }
+  pthread_rwlock_unlock(&log_filter_patterns_lock);
+  return pass;
+}
+
 void SetLogItems(bool enable_process_id, bool enable_thread_id,
                  bool enable_date, bool enable_timestamp,
                  bool enable_tickcount) {
@@ -268,15 +782,30 @@ void LogMessage::Init(const char* file, int line) {
   if (last_slash)
     file = last_slash + 1;
 
+  file_ = file;
+  line_ = line;
+  thread_id_ = CurrentThreadId();
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  timestamp_us_ = static_cast<int64>(now.tv_sec) * 1000000 + now.tv_usec;
+
+  // The JSON line is laid out from these fields once the message is
+  // complete, the stream only collects the message.
+  json_ = FLAGS_log_json;
+  if (json_) {
+    message_start_ = 0;
+    return;
+  }
+
   // TODO(darin): It might be nice if the columns were fixed width.
 
   stream_ <<  '[';
   if (log_process_id)
     stream_ << CurrentProcessId() << ':';
   if (log_thread_id)
-    stream_ << CurrentThreadId() << ':';
+    stream_ << thread_id_ << ':';
   if (log_date || log_timestamp) {
-    time_t t = time(NULL);
+    time_t t = now.tv_sec;
     struct tm local_time = {0};
     localtime_r(&t, &local_time);
     struct tm* tm_time = &local_time;
@@ -302,13 +831,25 @@ void LogMessage::Init(const char* file, int line) {
     stream_ << *(LogAdditionInfo::GetInstance());
   }
 
+  const LogContext* context = LogContext::Current();
+  if (!context->empty()) {
+    if (FLAGS_log_context_json) {
+      context->WriteJson(&stream_);
+      stream_ << ' ';
+    } else {
+      context->WriteText(&stream_);
+    }
+  }
+
   message_start_ = stream_.tellp();
 }
 
 LogMessage::~LogMessage() {
   // TODO(brettw) modify the macros so that nothing is executed when the log
   // level is too high.
-  if (severity_ < min_log_level)
+  const bool below_min_level = severity_ < min_log_level;
+  // The flight recorder keeps what the log level filters out.
+  if (below_min_level && !LogFlightRecorderEnabled())
     return;
 
   if (severity_ == LOG_FATAL) {
@@ -320,16 +861,75 @@ LogMessage::~LogMessage() {
   stream_ << std::endl;
   std::string str_newline(stream_.str());
 
+  LogRecord record;
+  record.severity = severity_;
+  record.file = file_;
+  record.line = line_;
+  record.thread_id = thread_id_;
+  record.timestamp_us = timestamp_us_;
+  const LogContext* context = LogContext::Current();
+  record.context =
+      context->empty() && context->business_id() == 0 ? NULL : context;
+
+  // With --log_json the stream holds only the message, which is moved to
+  // |message| and replaced with the JSON line.
+  std::string message;
+  if (json_) {
+    message.swap(str_newline);
+    record.message = message;
+    FormatLogRecord(record, LOG_FORMAT_JSON, &str_newline);
+  }
+  WriteToLogFlightRecorder(str_newline.data(), str_newline.size());
+  if (below_min_level)
+    return;
+
   // Give any log message handler first dibs on the message.
   if (log_message_handler && log_message_handler(severity_, str_newline))
     return;
 
-  if (log_filter_prefix && severity_ <= kMaxFilteredLogLevel &&
-      str_newline.compare(message_start_, log_filter_prefix->size(),
-                          log_filter_prefix->data()) != 0) {
+  record.text = str_newline;
+  if (!json_)
+    record.message = record.text.substr(message_start_);
+
+  // A summary of suppressed repeats stands for lines that passed already.
+  const bool filtered =
+      severity_ <= kMaxFilteredLogLevel && !writing_repeat_summary;
+  if (filtered && log_filter_prefix &&
+      !record.message.starts_with(*log_filter_prefix)) {
+    return;
+  }
+  if (filtered && !PassesLogFilterPatterns(record.message))
     return;
+
+  // Only lines that are written count as repeats, so a filtered line neither
+  // ends a storm nor takes its summary with it.
+  if (FLAGS_log_suppress_repeats && severity_ < LOG_FATAL &&
+      !writing_repeat_summary) {
+    int suppressed = 0;
+    if (!CheckRepeatedMessage(severity_, record.message, &suppressed))
+      return;
+    if (suppressed > 0) {
+      std::string summary;
+      if (json_) {
+        const std::string summary_message =
+            StringPrintf("%d repeats suppressed\n", suppressed);
+        LogRecord summary_record = record;
+        summary_record.message = summary_message;
+        summary_record.context = NULL;
+        FormatLogRecord(summary_record, LOG_FORMAT_JSON, &summary);
+      } else {
+        SStringPrintf(&summary, "[%s] %d repeats suppressed\n",
+                      log_severity_names[severity_], suppressed);
+      }
+      str_newline.insert(0, summary);
+      record.text = str_newline;
+      if (!json_)
+        record.message = record.text.substr(message_start_ + summary.size());
+    }
   }
 
+  SendToLogSinks(record);
+
   if (logging_destination == LOG_ONLY_TO_SYSTEM_DEBUG_LOG ||
       logging_destination == LOG_TO_BOTH_FILE_AND_SYSTEM_DEBUG_LOG) {
     {
@@ -359,7 +959,11 @@ LogMessage::~LogMessage() {
       InitializeLogFileHandle()) {
     // We can have multiple threads and/or processes, so try to prevent them
     // from clobbering each other's writes.
-    if (lock_log_file == LOCK_LOG_FILE) {
+    const bool atomic_append = lock_log_file == APPEND_LOG_FILE_ATOMICALLY;
+    const bool need_lock = !atomic_append || LogRotationEnabled();
+    if (!need_lock) {
+      // Nothing to do, the single write() below is atomic.
+    } else if (lock_log_file == LOCK_LOG_FILE) {
       // Ensure that the mutex is initialized in case the client app did not
       // call InitLogging. This is not thread safe. See below.
       InitLogMutex();
@@ -378,10 +982,23 @@ LogMessage::~LogMessage() {
       log_lock->Lock();
     }
 
-    fprintf(log_file, "%s", str_newline.c_str());
-    fflush(log_file);
+    if (need_lock)
+      RotateLogFileIfNeeded();
+    if (log_file && atomic_append) {
+      // Bypass stdio, which may split the record over several writes.
+      WriteToLogFileAtomically(str_newline);
+      // Only rotation reads the size, and it only runs under the lock.
+      if (need_lock)
+        log_file_size += str_newline.size();
+    } else if (log_file) {
+      fprintf(log_file, "%s", str_newline.c_str());
+      fflush(log_file);
+      log_file_size += str_newline.size();
+    }
 
-    if (lock_log_file == LOCK_LOG_FILE) {
+    if (!need_lock) {
+      // No lock to release.
+    } else if (lock_log_file == LOCK_LOG_FILE) {
       pthread_mutex_unlock(&log_mutex);
     } else {
       log_lock->Unlock();
@@ -389,6 +1006,9 @@ LogMessage::~LogMessage() {
   }
 
   if (severity_ == LOG_FATAL) {
+    DumpLogFlightRecorderOnCrash();
+    FlushLogSinksWithTimeout(kFatalSinkFlushTimeoutMs);
+
     // display a message or break into the debugger on a fatal error
     if (DebugUtil::BeingDebugged()) {
       DebugUtil::BreakDebugger();
@@ -419,6 +1039,37 @@ LogMessage::~LogMessage() {
   }
 }
 
+bool LogRateState::Allow(double per_second, int burst) {
+  if (!(per_second > 0)) {
+    base::AtomicIncrement(&suppressed);
+    return false;
+  }
+  const int64 interval = std::max(static_cast<int64>(1000000 / per_second),
+                                  static_cast<int64>(1));
+  const int64 tolerance = interval * (std::max(burst, 1) - 1);
+  const int64 now = MonotonicMicros();
+
+  int64 full_at = full_at_us;
+  while (true) {
+    const int64 start = std::max(full_at, now);
+    if (start - now > tolerance) {
+      base::AtomicIncrement(&suppressed);
+      return false;
+    }
+    const int64 prev = base::AtomicCompareAndSwap(&full_at_us, full_at,
+                                                  start + interval);
+    if (prev == full_at)
+      return true;
+    full_at = prev;
+  }
+}
+
+std::ostream& operator<<(std::ostream& out, const LogSuppressedCount& n) {
+  if (n.count > 0)
+    out << "[" << n.count << " suppressed] ";
+  return out;
+}
+
 SystemErrorCode GetLastSystemErrorCode() {
   return errno;
 }
@@ -435,7 +1086,12 @@ ErrnoLogMessage::~ErrnoLogMessage() {
   stream() << ": " << safe_strerror(err_);
 }
 
+void FlushSuppressedRepeats() {
+  WriteSuppressedRepeats(false);
+}
+
 void CloseLogFile() {
+  FlushSuppressedRepeats();
   if (!log_file)
     return;
 
@@ -474,34 +1130,231 @@ void RawLog(int level, const char* message) {
     DebugUtil::BreakDebugger();
 }
 
+// Copies |src| into the fixed size buffer |dst|, truncating if needed.
+template <size_t N>
+void CopyToBuffer(const base::StringPiece& src, char (&dst)[N]) {
+  size_t len = std::min(src.size(), N - 1);
+  memcpy(dst, src.data(), len);
+  dst[len] = '\0';
+}
+
+inline void AppendBytes(const char* data, size_t size, std::string* out) {
+  out->append(data, size);
+}
+
+inline void AppendBytes(const char* data, size_t size, std::ostream* out) {
+  out->write(data, size);
+}
+
+// Appends |str| to |out|, a std::string or a std::ostream, as a quoted JSON
+// string. Runs of plain characters are appended in one go.
+template <typename Output>
+void AppendQuotedJson(const base::StringPiece& str, Output* out) {
+  static const char kHex[] = "0123456789abcdef";
+  AppendBytes("\"", 1, out);
+  const char* run = str.data();
+  const char* end = str.data() + str.size();
+  for (const char* p = run; p != end; ++p) {
+    const unsigned char c = *p;
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+    AppendBytes(run, p - run, out);
+    run = p + 1;
+    switch (c) {
+      case '"': AppendBytes("\\\"", 2, out); break;
+      case '\\': AppendBytes("\\\\", 2, out); break;
+      case '\n': AppendBytes("\\n", 2, out); break;
+      case '\r': AppendBytes("\\r", 2, out); break;
+      case '\t': AppendBytes("\\t", 2, out); break;
+      default: {
+        char escaped[6] = { '\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 15] };
+        AppendBytes(escaped, sizeof(escaped), out);
+      }
+    }
+  }
+  AppendBytes(run, end - run, out);
+  AppendBytes("\"", 1, out);
+}
+
+void AppendJsonString(const base::StringPiece& str, std::string* out) {
+  AppendQuotedJson(str, out);
+}
+
+thread_local LogContext current_log_context;
+
+LogContext* LogContext::Current() {
+  return &current_log_context;
+}
+
+void LogContext::CopyFrom(const LogContext& other) {
+  request_id_ = other.request_id_;
+  business_id_ = other.business_id_;
+  CopyToBuffer(other.trace_id_, trace_id_);
+  num_fields_ = other.num_fields_;
+  std::copy(other.fields_, other.fields_ + other.num_fields_, fields_);
+}
+
+void LogContext::SetTraceId(const base::StringPiece& trace_id) {
+  CopyToBuffer(trace_id, trace_id_);
+}
+
+int LogContext::FindField(const base::StringPiece& key) const {
+  for (int i = 0; i < num_fields_; ++i) {
+    if (key.compare(fields_[i].key) == 0)
+      return i;
+  }
+  return -1;
+}
+
+// |key| as it is stored, so it can be compared with stored keys.
+base::StringPiece StoredKey(const base::StringPiece& key) {
+  return base::StringPiece(
+      key.data(), std::min<size_t>(key.size(), LogContext::kMaxKeySize - 1));
+}
+
+bool LogContext::SetField(const base::StringPiece& key,
+                          const base::StringPiece& value) {
+  const base::StringPiece stored_key = StoredKey(key);
+  int i = FindField(stored_key);
+  if (i < 0) {
+    if (num_fields_ == kMaxFields)
+      return false;
+    i = num_fields_++;
+    CopyToBuffer(stored_key, fields_[i].key);
+  }
+  CopyToBuffer(value, fields_[i].value);
+  return true;
+}
+
+bool LogContext::SetField(const base::StringPiece& key, int64 value) {
+  char buffer[24];
+  int len = snprintf(buffer, sizeof(buffer), "%" YRd64, value);
+  return SetField(key, base::StringPiece(buffer, len));
+}
+
+void LogContext::RemoveField(const base::StringPiece& key) {
+  int i = FindField(StoredKey(key));
+  if (i < 0)
+    return;
+  --num_fields_;
+  if (i != num_fields_)
+    fields_[i] = fields_[num_fields_];
+}
+
+const char* LogContext::GetField(const base::StringPiece& key) const {
+  int i = FindField(StoredKey(key));
+  return i < 0 ? NULL : fields_[i].value;
+}
+
+void LogContext::Clear() {
+  request_id_ = 0;
+  business_id_ = 0;
+  trace_id_[0] = '\0';
+  num_fields_ = 0;
+}
+
+void LogContext::WriteText(std::ostream* out) const {
+  const char* separator = "";
+  out->put('[');
+  if (request_id_ != 0) {
+    *out << "rid:" << request_id_;
+    separator = " ";
+  }
+  if (trace_id_[0] != '\0') {
+    *out << separator << "trace:" << trace_id_;
+    separator = " ";
+  }
+  for (int i = 0; i < num_fields_; ++i) {
+    *out << separator << fields_[i].key << '=' << fields_[i].value;
+    separator = " ";
+  }
+  out->write("] ", 2);
+}
+
+void LogContext::WriteJson(std::ostream* out) const {
+  out->put('{');
+  AppendJsonMembers(false, out);
+  out->put('}');
+}
+
+void LogContext::WriteJsonMembers(std::ostream* out) const {
+  AppendJsonMembers(true, out);
+}
+
+void LogContext::AppendJsonMembers(std::string* out) const {
+  AppendJsonMembers(true, out);
+}
+
+template <typename Output>
+void LogContext::AppendJsonMembers(bool leading_comma, Output* out) const {
+  if (request_id_ != 0) {
+    char buffer[48];
+    int len = snprintf(buffer, sizeof(buffer), "%s\"request_id\":%" YRu64,
+                       leading_comma ? "," : "", request_id_);
+    AppendBytes(buffer, len, out);
+    leading_comma = true;
+  }
+  if (trace_id_[0] != '\0') {
+    if (leading_comma)
+      AppendBytes(",", 1, out);
+    AppendBytes("\"trace_id\":", 11, out);
+    AppendQuotedJson(trace_id_, out);
+    leading_comma = true;
+  }
+  for (int i = 0; i < num_fields_; ++i) {
+    if (leading_comma)
+      AppendBytes(",", 1, out);
+    AppendQuotedJson(fields_[i].key, out);
+    AppendBytes(":", 1, out);
+    AppendQuotedJson(fields_[i].value, out);
+    leading_comma = true;
+  }
+}
+
+ScopedLogContextField::ScopedLogContextField(const base::StringPiece& key,
+                                             const base::StringPiece& value) {
+  LogContext* context = LogContext::Current();
+  CopyToBuffer(key, key_);
+  const char* previous = context->GetField(key_);
+  had_previous_ = previous != NULL;
+  if (had_previous_)
+    CopyToBuffer(previous, previous_);
+  context->SetField(key_, value);
+}
+
+ScopedLogContextField::~ScopedLogContextField() {
+  if (had_previous_)
+    LogContext::Current()->SetField(key_, previous_);
+  else
+    LogContext::Current()->RemoveField(key_);
+}
+
 LogAdditionInfo* LogAdditionInfo::GetInstance() {
   static LogAdditionInfo *instance = new LogAdditionInfo;
   return instance;
 }
 
 LogAdditionInfo::LogAdditionInfo() {
-  pthread_key_create(&business_id_key_, NULL);
 }
 
 LogAdditionInfo::~LogAdditionInfo() {
-  pthread_key_delete(business_id_key_);
 }
 
 std::ostream& operator<<(std::ostream &out, const LogAdditionInfo &info) {
-  void *value = pthread_getspecific(info.business_id_key_);
-  if (value) {
-    out << "[bid:" << reinterpret_cast<uint64>(value) << "] ";
+  uint64 bid = LogContext::Current()->business_id();
+  if (bid) {
+    out << "[bid:" << bid << "] ";
   }
 
   return out;
 }
 
 void LogAdditionInfo::AddBusinessIDByThread(uint64 bid) {
-  pthread_setspecific(business_id_key_, reinterpret_cast<void*>(bid));
+  LogContext::Current()->set_business_id(bid);
 }
 
 void LogAdditionInfo::RemoveBusinessIDByThread() {
-  pthread_setspecific(business_id_key_, NULL);
+  LogContext::Current()->set_business_id(0);
 }
 
 }  // namespace logging
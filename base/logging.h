@@ -8,9 +8,12 @@
 #include <string>
 #include <cstring>
 #include <sstream>
+#include <vector>
 
+#include "base/atomic.h"
 #include "base/basictypes.h"
 #include "base/flags.h"
+#include "base/string_piece.h"
 
 //
 // Optional message capabilities
@@ -49,9 +52,27 @@
 //
 //   LOG_IF(INFO, num_cookies > 10) << "Got lots of cookies";
 //
+// Noisy call sites can be sampled or rate limited:
+//
+//   LOG_EVERY_N(INFO, 10) << "Got a packet";
+//
 // The above will cause log messages to be output on the 1st, 11th, 21st, ...
-// times it is executed.  Note that the special COUNTER value is used to
-// identify which repetition is happening.
+// times it is executed.  Likewise
+//
+//   LOG_FIRST_N(INFO, 20) << "Got a packet";
+//   LOG_EVERY_T(INFO, 5) << "Got a packet";
+//   LOG_TOKEN_BUCKET(INFO, 100, 20) << "Got a packet";
+//
+// log the first 20 executions, at most once every 5 seconds, and at most 100
+// per second with bursts of up to 20.  The time based forms prefix the message
+// with the number of messages they dropped since the last one got through.
+// Each call site keeps its own lock-free state.
+//
+// With --log_suppress_repeats, a message identical to the previous one
+// written (same severity and text, ignoring the prefix) is dropped, and the next message
+// that does get written is preceded by an "N repeats suppressed" line.  A
+// storm followed by silence is reported by a background timer, at exit, and
+// by FlushSuppressedRepeats().
 //
 // The CHECK(condition) macro is active in both debug and release builds and
 // effectively performs a LOG(FATAL) which terminates the process and
@@ -103,8 +124,38 @@
 // debug mode, ERROR in normal mode.
 
 DECLARE_int32(v);
+// Per module verbose levels as a comma separated list of <pattern>=<level>,
+// e.g. "http_*=2,base/hash=1".  A pattern containing '/' is matched against
+// the full source path without extension, any other pattern against the
+// file's base name without extension.  Patterns use MatchPatternASCII()
+// wildcards and the first match wins; unmatched files use --v.
+DECLARE_string(vmodule);
 DECLARE_bool(enable_addition_info_business_id);
 
+// Log file rotation
+// -----------------
+// When --log_rotate_size_mb or --log_rotate_interval_sec is set, the log file
+// passed to InitLogging is turned into a symlink to the file actually being
+// written, named "<log_file>.YYYYMMDD-HHMMSS.<pid>.<sequence>" so that the
+// files of a process sort in creation order.  The thread whose write crosses
+// a limit opens the next file and moves the symlink while holding the log
+// lock; nothing is renamed or copied.  Finished files are compressed with
+// base/block_compress.h (--log_compress_rotated, suffix ".blz") and pruned to
+// the newest --log_max_rotated_files on a background thread.
+DECLARE_int32(log_rotate_size_mb);
+DECLARE_int32(log_rotate_interval_sec);
+DECLARE_int32(log_max_rotated_files);
+DECLARE_bool(log_compress_rotated);
+DECLARE_bool(log_suppress_repeats);
+DECLARE_bool(log_context_json);
+
+// With --log_json every log line is a JSON object instead of the usual
+// "[tid:MMDD/HHMMSS:SEVERITY:file(line)] message" text:
+//   {"time":"2026-01-02T03:04:05.678901Z","severity":"INFO","file":"a.cc",
+//    "line":12,"tid":345,"request_id":42,"user":"bob","message":"handled"}
+// The time is UTC. Context fields (see LogContext) are top level members.
+DECLARE_bool(log_json);
+
 namespace logging {
 
 // Where to record logging output? A flat file and/or system debug log via
@@ -123,7 +174,14 @@ enum LoggingDestination { LOG_NONE,
 //
 // All processes writing to the log file must have their locking set for it to
 // work properly. Defaults to DONT_LOCK_LOG_FILE.
-enum LogLockingState { LOCK_LOG_FILE, DONT_LOCK_LOG_FILE };
+//
+// APPEND_LOG_FILE_ATOMICALLY takes no lock at all: each record is written
+// with a single write() to the file opened with O_APPEND, which the kernel
+// does not interleave with the writes of other threads or processes sharing
+// the file. The in-process lock is still taken while rotation is enabled,
+// since switching files must not race with writes.
+enum LogLockingState { LOCK_LOG_FILE, DONT_LOCK_LOG_FILE,
+                       APPEND_LOG_FILE_ATOMICALLY };
 
 // On startup, should we delete or append to an existing log file (if any)?
 // Defaults to APPEND_TO_OLD_LOG_FILE.
@@ -158,6 +216,17 @@ int GetMinLogLevel();
 // with severity of LOG_ERROR or higher will not be filtered.
 void SetLogFilterPrefix(const char* filter);
 
+// Filters log messages below LOG_ERROR severity by a set of substrings.
+// With LOG_FILTER_DROP_MATCHING, messages containing any of |patterns| are
+// ignored; with LOG_FILTER_KEEP_MATCHING, only those are logged. The
+// patterns are compiled once into an Aho-Corasick automaton (see
+// base/aho_corasick.h), so each message is scanned once whatever their
+// number. An empty |patterns| removes the filter. Applies after the filter
+// prefix and before log sinks.
+enum LogFilterMode { LOG_FILTER_KEEP_MATCHING, LOG_FILTER_DROP_MATCHING };
+void SetLogFilterPatterns(const std::vector<std::string>& patterns,
+                          LogFilterMode mode, bool ignore_case);
+
 // Sets the common items you want to be prepended to each log message.
 // process and thread IDs default to on, the timestamp defaults to on.
 void SetLogItems(bool enable_process_id, bool enable_thread_id, bool enable_date,
@@ -183,6 +252,9 @@ void SetLogReportHandler(LogReportHandlerFunction handler);
 typedef bool (*LogMessageHandlerFunction)(int severity, const std::string& str);
 void SetLogMessageHandler(LogMessageHandlerFunction handler);
 
+// To send log messages to several destinations, each with its own minimum
+// severity and format, see base/log_sink.h.
+
 typedef int LogSeverity;
 const LogSeverity LOG_INFO = 0;
 const LogSeverity LOG_WARNING = 1;
@@ -191,6 +263,9 @@ const LogSeverity LOG_ERROR_REPORT = 3;
 const LogSeverity LOG_FATAL = 4;
 const LogSeverity LOG_NUM_SEVERITIES = 5;
 
+// Returns the name of |severity| as it appears in log lines, e.g. "WARNING".
+const char* LogSeverityName(LogSeverity severity);
+
 // LOG_DFATAL_LEVEL is LOG_FATAL in debug mode, ERROR in normal mode
 #ifdef NDEBUG
 const LogSeverity LOG_DFATAL_LEVEL = LOG_ERROR;
@@ -260,14 +335,108 @@ const LogSeverity LOG_DFATAL_LEVEL = LOG_FATAL;
 #define SYSLOG_ASSERT(condition) \
   SYSLOG_IF(FATAL, !(condition)) << "Assert failed: " #condition ". "
 
-#define VLOG_IS_ON(verboselevel) (FLAGS_v >= (verboselevel))
+// Verbose level of a VLOG call site, cached in a per call site static.  The
+// cache is tagged with vlog_generation, which is bumped whenever --v or
+// --vmodule is changed through SetCommandLineOption or flag parsing, so the
+// common case is one load and one compare.  Sites that no --vmodule pattern
+// matches follow FLAGS_v directly, so assigning FLAGS_v still works.
+struct VlogSiteState {
+  volatile int32 generation;
+  volatile int32 level;
+};
+
+const int32 kVlogUseGlobalLevel = kint32min;
+extern volatile int32 vlog_generation;
+
+// Matches |file| against --vmodule and caches the result in |site|.
+int ResolveVlogSite(VlogSiteState* site, const char* file);
+
+inline int VlogSiteLevel(VlogSiteState* site, const char* file) {
+  if (site->generation != vlog_generation)
+    return ResolveVlogSite(site, file);
+  const int level = site->level;
+  return level == kVlogUseGlobalLevel ? FLAGS_v : level;
+}
+
+#define VLOG_IS_ON(verboselevel) \
+  (logging::VlogSiteLevel(&LOG_CALL_SITE_STATE(logging::VlogSiteState), \
+                          __FILE__) >= (verboselevel))
 #define VLOG(verboselevel) LOG_IF(INFO, VLOG_IS_ON(verboselevel))
 
 #define VLOG_IS_ON_RAISED(verboselevel, raised_log_level) \
-  ((raised_log_level) >= (verboselevel) || FLAGS_v >= (verboselevel))
+  ((raised_log_level) >= (verboselevel) || VLOG_IS_ON(verboselevel))
 #define VLOG_RAISED(verboselevel, raised_log_level) \
   LOG_IF(INFO, VLOG_IS_ON_RAISED(verboselevel, raised_log_level))
 
+// Per call site state of LOG_EVERY_N and friends.  These are plain structs
+// so that the function-local statics holding them are zero initialized at
+// load time and need no initialization guard.
+struct LogEveryNState {
+  volatile uint32 count;
+
+  bool ShouldLog(uint32 n) {
+    return n > 0 && (base::AtomicIncrement(&count) - 1) % n == 0;
+  }
+};
+
+struct LogFirstNState {
+  volatile uint32 count;
+
+  bool ShouldLog(uint32 n) {
+    // Stop counting once the limit is reached so the counter can't wrap.
+    return count < n && base::AtomicIncrement(&count) <= n;
+  }
+};
+
+// A token bucket implemented as a generic cell rate algorithm, so the whole
+// bucket is a single word updated with compare-and-swap.
+struct LogRateState {
+  // The time, in monotonic microseconds, at which the bucket is full again.
+  volatile int64 full_at_us;
+  // Messages dropped since the last one that was let through.
+  volatile uint32 suppressed;
+
+  // Takes a token from a bucket refilled at |per_second| tokens per second
+  // and holding at most |burst| tokens.
+  bool Allow(double per_second, int burst);
+  // Returns and resets the suppressed count.
+  uint32 TakeSuppressed() {
+    return __sync_lock_test_and_set(&suppressed, 0);
+  }
+};
+
+// Streams "[N suppressed] " for a non-zero count, nothing otherwise.
+struct LogSuppressedCount {
+  explicit LogSuppressedCount(uint32 n) : count(n) {}
+  uint32 count;
+};
+std::ostream& operator<<(std::ostream& out, const LogSuppressedCount& n);
+
+// Evaluates to a reference to a zero initialized static of |type| that is
+// private to the call site.
+#define LOG_CALL_SITE_STATE(type) \
+  (*({ static type log_call_site_state_; &log_call_site_state_; }))
+
+#define LOG_EVERY_N(severity, n) \
+  LOG_IF(severity, \
+         LOG_CALL_SITE_STATE(logging::LogEveryNState).ShouldLog(n))
+
+#define LOG_FIRST_N(severity, n) \
+  LOG_IF(severity, \
+         LOG_CALL_SITE_STATE(logging::LogFirstNState).ShouldLog(n))
+
+#define LOG_TOKEN_BUCKET(severity, per_second, burst) \
+  for (logging::LogRateState* log_rate_state_ = \
+           &LOG_CALL_SITE_STATE(logging::LogRateState); \
+       log_rate_state_ != NULL && log_rate_state_->Allow((per_second), \
+                                                         (burst)); \
+       log_rate_state_ = NULL) \
+    LOG(severity) << logging::LogSuppressedCount( \
+        log_rate_state_->TakeSuppressed())
+
+#define LOG_EVERY_T(severity, seconds) \
+  LOG_TOKEN_BUCKET(severity, 1.0 / (seconds), 1)
+
 #define LOG_ERRNO(severity) \
   COMPACT_GOOGLE_LOG_EX_ ## severity(ErrnoLogMessage, \
       ::logging::GetLastSystemErrorCode()).stream()
@@ -582,6 +751,11 @@ class LogMessage {
   void Init(const char* file, int line);
 
   LogSeverity severity_;
+  const char* file_;
+  int line_;
+  int32 thread_id_;
+  int64 timestamp_us_;    // Wall clock time, microseconds since the epoch.
+  bool json_;             // Laid out as a JSON line, see --log_json.
   std::ostringstream stream_;
   size_t message_start_;  // Offset of the start of the message (past prefix
                           // info).
@@ -632,12 +806,19 @@ class ErrnoLogMessage {
   DISALLOW_COPY_AND_ASSIGN(ErrnoLogMessage);
 };
 
+// Writes the "N repeats suppressed" line of --log_suppress_repeats for a
+// storm still unreported. Called by CloseLogFile() and FlushLogSinks().
+void FlushSuppressedRepeats();
+
 // Closes the log file explicitly if open.
 // NOTE: Since the log file is opened as necessary by the action of logging
 //       statements, there's no guarantee that it will stay closed
 //       after this call.
 void CloseLogFile();
 
+// See base/log_flight_recorder.h for keeping the most recent log records
+// of every severity in memory and dumping them on a crash.
+
 // Async signal safe logging mechanism.
 void RawLog(int level, const char* message);
 
@@ -657,6 +838,133 @@ void RawLog(int level, const char* message);
 #define LOG_ADDITION_INFO_BUSINESS_ID(bid) \
   logging::ScopedLogAdditionInfoBusinessID scoped_log_bid(bid, true)
 
+// Appends |str| to |out| as a quoted JSON string.
+void AppendJsonString(const base::StringPiece& str, std::string* out);
+
+// Structured context written with every log line of the thread that owns it:
+// a request id, a trace id and a few key/value fields.  It lives in fixed
+// size thread_local storage, so setting it and logging it never allocate.
+// base::ThreadPool copies the context of the thread calling AddTask() and
+// installs it on the worker while the task runs.
+//
+//   logging::LogContext* context = logging::LogContext::Current();
+//   context->set_request_id(request.id());
+//   context->SetField("user", request.user());
+//   LOG(INFO) << "handled";  // [...] [rid:42 user=bob] handled
+//
+// With --log_context_json the context is written as a JSON object instead.
+class LogContext {
+ public:
+  static const int kMaxFields = 8;
+  // Sizes include the terminating NUL; longer strings are truncated.
+  static const int kMaxKeySize = 16;
+  static const int kMaxValueSize = 48;
+  static const int kMaxTraceIdSize = 64;
+
+  // Leaves the context uninitialized, so that the thread_local instance is
+  // zero initialized without any per thread setup.
+  LogContext() = default;
+  // Copies only the fields in use, so passing a context along with a task,
+  // as base::ThreadPool does, stays cheap.
+  LogContext(const LogContext& other) { CopyFrom(other); }
+  LogContext& operator=(const LogContext& other) {
+    if (this != &other)
+      CopyFrom(other);
+    return *this;
+  }
+
+  // Returns the calling thread's context.  Never NULL.
+  static LogContext* Current();
+
+  uint64 request_id() const { return request_id_; }
+  void set_request_id(uint64 request_id) { request_id_ = request_id; }
+
+  uint64 business_id() const { return business_id_; }
+  void set_business_id(uint64 business_id) { business_id_ = business_id; }
+
+  const char* trace_id() const { return trace_id_; }
+  void SetTraceId(const base::StringPiece& trace_id);
+
+  // Sets |key| to |value|, replacing a field with the same key.  Returns
+  // false if all kMaxFields slots are taken by other keys.
+  bool SetField(const base::StringPiece& key, const base::StringPiece& value);
+  bool SetField(const base::StringPiece& key, int64 value);
+  void RemoveField(const base::StringPiece& key);
+  // Returns the value of |key|, or NULL if it is not set.
+  const char* GetField(const base::StringPiece& key) const;
+
+  // Removes everything, including the business id.
+  void Clear();
+
+  // True if there is nothing to write besides the business id, which is
+  // written separately by LogAdditionInfo.
+  bool empty() const {
+    return request_id_ == 0 && trace_id_[0] == '\0' && num_fields_ == 0;
+  }
+
+  // Writes "[rid:<id> trace:<id> <key>=<value>...] ".
+  void WriteText(std::ostream* out) const;
+  // Writes the context as a JSON object, e.g. {"request_id":42,"user":"bob"}
+  void WriteJson(std::ostream* out) const;
+  // Writes the same members without braces, each preceded by a comma, for
+  // embedding in an enclosing object.
+  void WriteJsonMembers(std::ostream* out) const;
+  // Appends the same members to |out|.
+  void AppendJsonMembers(std::string* out) const;
+
+ private:
+  struct Field {
+    char key[kMaxKeySize];
+    char value[kMaxValueSize];
+  };
+
+  void CopyFrom(const LogContext& other);
+  int FindField(const base::StringPiece& key) const;
+  // |out| is a std::string or a std::ostream.
+  template <typename Output>
+  void AppendJsonMembers(bool leading_comma, Output* out) const;
+
+  uint64 request_id_;
+  uint64 business_id_;
+  char trace_id_[kMaxTraceIdSize];
+  int num_fields_;
+  Field fields_[kMaxFields];
+};
+
+// Installs a copy of |context| as the calling thread's context and restores
+// the previous one when destroyed.
+class ScopedLogContext {
+ public:
+  explicit ScopedLogContext(const LogContext& context)
+      : saved_(*LogContext::Current()) {
+    *LogContext::Current() = context;
+  }
+  ~ScopedLogContext() { *LogContext::Current() = saved_; }
+
+ private:
+  LogContext saved_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedLogContext);
+};
+
+// Sets a field of the calling thread's context for the current scope, and
+// puts back the value the field had before, if any, when the scope ends.
+class ScopedLogContextField {
+ public:
+  ScopedLogContextField(const base::StringPiece& key,
+                        const base::StringPiece& value);
+  ~ScopedLogContextField();
+
+ private:
+  char key_[LogContext::kMaxKeySize];
+  bool had_previous_;
+  char previous_[LogContext::kMaxValueSize];
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedLogContextField);
+};
+
+// The business id is kept in LogContext, so it also follows tasks posted to
+// a base::ThreadPool.
 class LogAdditionInfo {
  public:
   static LogAdditionInfo* GetInstance();
@@ -669,8 +977,6 @@ class LogAdditionInfo {
   void RemoveBusinessIDByThread();
 
  private:
-  pthread_key_t business_id_key_;
-
   DISALLOW_COPY_AND_ASSIGN(LogAdditionInfo);
 };
 
@@ -0,0 +1,269 @@
+// Description : Cache shared between threads, bounded by a budget in bytes,
+//               with an optional time to live per entry. Keys are spread
+//               over shards, each with its own RwMutex. Eviction follows the
+//               CLOCK approximation of LRU: a hit only sets a flag on the
+//               entry, so lookups take the reader lock, and an insertion
+//               that needs room sweeps a hand over the entries, evicting the
+//               first one not hit since the hand last passed it.
+//
+// Usage:
+//   base::LruCache<std::string, std::string> pages(64 << 20);
+//   pages.Insert(url, body, body.size(), base::TimeDelta::FromMinutes(5));
+//   std::string body;
+//   if (pages.Get(url, &body)) ...
+
+#ifndef PUBLIC_BASE_LRU_CACHE_H_
+#define PUBLIC_BASE_LRU_CACHE_H_
+
+#include <vector>
+
+#include "base/atomic.h"
+#include "base/basictypes.h"
+#include "base/flat_hash_map.h"
+#include "base/mutex.h"
+#include "base/time.h"
+
+namespace base {
+
+struct LruCacheStats {
+  uint64 hits;
+  uint64 misses;
+  uint64 evictions;    // Entries dropped to make room.
+  uint64 expirations;  // Entries dropped because their time to live ran out.
+  size_t entries;
+  size_t bytes;
+};
+
+// Key and Value must be default constructible and copyable.
+template <typename Key, typename Value, typename Hash = FlatHash<Key>,
+          typename Equal = FlatEqual<Key> >
+class LruCache {
+ public:
+  // The cache holds at most |capacity_bytes|, as counted by the charges
+  // given to Insert(), split evenly over |num_shards|, rounded up to a
+  // power of two.
+  explicit LruCache(size_t capacity_bytes, int num_shards = 16)
+      : shard_shift_(64), shards_(NULL), num_shards_(1) {
+    while (num_shards_ < num_shards) {
+      num_shards_ *= 2;
+      --shard_shift_;
+    }
+    shards_ = new Shard[num_shards_];
+    for (int i = 0; i < num_shards_; ++i)
+      shards_[i].capacity = capacity_bytes / num_shards_;
+  }
+
+  ~LruCache() { delete[] shards_; }
+
+  // Copies the value of |key| to |value| and returns true if it is cached
+  // and has not expired. |value| may be NULL.
+  template <typename K>
+  bool Get(const K& key, Value* value) const {
+    Shard& shard = ShardFor(key);
+    ReaderMutexLock lock(&shard.mutex);
+    typename IndexMap::const_iterator it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      Entry& entry = shard.entries[it->second];
+      if (entry.expiry.is_null() || TimeTicks::Now() < entry.expiry) {
+        // Checked first so hits on a hot entry do not keep writing its
+        // cache line.
+        if (!__atomic_load_n(&entry.referenced, __ATOMIC_RELAXED))
+          __atomic_store_n(&entry.referenced, true, __ATOMIC_RELAXED);
+        if (value)
+          *value = entry.value;
+        AtomicIncrement(&shard.hits);
+        return true;
+      }
+    }
+    AtomicIncrement(&shard.misses);
+    return false;
+  }
+
+  // Caches |value| for |key|, replacing any cached value, and counts it as
+  // |charge| bytes. With a nonzero |ttl| the entry expires after it.
+  // Evicts entries of the same shard as needed. Returns false, caching
+  // nothing, if |charge| exceeds the budget of a shard.
+  bool Insert(const Key& key, const Value& value, size_t charge,
+              TimeDelta ttl = TimeDelta()) {
+    Shard& shard = ShardFor(key);
+    if (charge > shard.capacity)
+      return false;
+    const TimeTicks expiry =
+        ttl.ToInternalValue() > 0 ? TimeTicks::Now() + ttl : TimeTicks();
+
+    WriterMutexLock lock(&shard.mutex);
+    typename IndexMap::iterator it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      // Drop the old charge so only the difference needs room; the entry
+      // itself is never evicted for its own update.
+      const uint32 slot = it->second;
+      shard.usage -= shard.entries[slot].charge;
+      shard.entries[slot].charge = 0;
+      MakeRoom(&shard, charge, slot);
+      Entry& entry = shard.entries[slot];
+      entry.value = value;
+      entry.charge = charge;
+      entry.expiry = expiry;
+      entry.referenced = true;
+      shard.usage += charge;
+      return true;
+    }
+
+    MakeRoom(&shard, charge, kNoSlot);
+    uint32 slot;
+    if (!shard.free_slots.empty()) {
+      slot = shard.free_slots.back();
+      shard.free_slots.pop_back();
+    } else {
+      slot = static_cast<uint32>(shard.entries.size());
+      shard.entries.push_back(Entry());
+    }
+    Entry& entry = shard.entries[slot];
+    entry.key = key;
+    entry.value = value;
+    entry.charge = charge;
+    entry.expiry = expiry;
+    entry.referenced = false;
+    entry.in_use = true;
+    shard.usage += charge;
+    shard.index[key] = slot;
+    return true;
+  }
+
+  // Removes |key|. Returns whether it was cached.
+  template <typename K>
+  bool Erase(const K& key) {
+    Shard& shard = ShardFor(key);
+    WriterMutexLock lock(&shard.mutex);
+    typename IndexMap::iterator it = shard.index.find(key);
+    if (it == shard.index.end())
+      return false;
+    const uint32 slot = it->second;
+    shard.index.erase(it);
+    Release(&shard, slot);
+    return true;
+  }
+
+  void Clear() {
+    for (int i = 0; i < num_shards_; ++i) {
+      Shard& shard = shards_[i];
+      WriterMutexLock lock(&shard.mutex);
+      shard.index.clear();
+      shard.entries.clear();
+      shard.free_slots.clear();
+      shard.usage = 0;
+      shard.hand = 0;
+    }
+  }
+
+  // Counters summed over the shards since construction.
+  LruCacheStats GetStats() const {
+    LruCacheStats stats = { 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < num_shards_; ++i) {
+      Shard& shard = shards_[i];
+      ReaderMutexLock lock(&shard.mutex);
+      stats.hits += shard.hits;
+      stats.misses += shard.misses;
+      stats.evictions += shard.evictions;
+      stats.expirations += shard.expirations;
+      stats.entries += shard.index.size();
+      stats.bytes += shard.usage;
+    }
+    return stats;
+  }
+
+ private:
+  static const uint32 kNoSlot = kuint32max;
+
+  struct Entry {
+    Entry() : key(), value(), charge(0), referenced(false), in_use(false) {}
+
+    Key key;
+    Value value;
+    size_t charge;
+    TimeTicks expiry;  // Null if the entry does not expire.
+    // Set by hits under the reader lock, cleared by the clock hand.
+    bool referenced;
+    bool in_use;
+  };
+
+  typedef flat_hash_map<Key, uint32, Hash, Equal> IndexMap;
+
+  struct Shard {
+    Shard() : capacity(0), usage(0), hand(0), hits(0), misses(0),
+              evictions(0), expirations(0) {}
+
+    mutable RwMutex mutex;
+    IndexMap index;
+    // The clock: slots of freed entries are reused.
+    std::vector<Entry> entries;
+    std::vector<uint32> free_slots;
+    size_t capacity;
+    size_t usage;
+    size_t hand;
+    volatile uint64 hits;
+    volatile uint64 misses;
+    uint64 evictions;
+    uint64 expirations;
+    // Keeps the next shard's lock and counters off this shard's cache lines.
+    char padding[64];
+  };
+
+  // Sweeps the clock hand until |charge| more bytes fit, never evicting
+  // |keep|.
+  void MakeRoom(Shard* shard, size_t charge, uint32 keep) {
+    TimeTicks now;
+    while (shard->usage + charge > shard->capacity) {
+      const uint32 slot = static_cast<uint32>(shard->hand);
+      shard->hand = (shard->hand + 1) % shard->entries.size();
+      Entry& entry = shard->entries[slot];
+      if (!entry.in_use || slot == keep)
+        continue;
+      if (!entry.expiry.is_null()) {
+        if (now.is_null())
+          now = TimeTicks::Now();
+        if (entry.expiry <= now) {
+          ++shard->expirations;
+          Evict(shard, slot);
+          continue;
+        }
+      }
+      if (entry.referenced) {
+        entry.referenced = false;
+        continue;
+      }
+      ++shard->evictions;
+      Evict(shard, slot);
+    }
+  }
+
+  void Evict(Shard* shard, uint32 slot) {
+    shard->index.erase(shard->entries[slot].key);
+    Release(shard, slot);
+  }
+
+  // Frees |slot|, already removed from the index.
+  void Release(Shard* shard, uint32 slot) {
+    Entry& entry = shard->entries[slot];
+    shard->usage -= entry.charge;
+    entry = Entry();
+    shard->free_slots.push_back(slot);
+  }
+
+  template <typename K>
+  Shard& ShardFor(const K& key) const {
+    if (num_shards_ == 1)
+      return shards_[0];
+    return shards_[static_cast<uint64>(Hash()(key)) >> shard_shift_];
+  }
+
+  int shard_shift_;
+  Shard* shards_;
+  int num_shards_;
+
+  DISALLOW_COPY_AND_ASSIGN(LruCache);
+};
+
+}  // namespace base
+
+#endif  // PUBLIC_BASE_LRU_CACHE_H_
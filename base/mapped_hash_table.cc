@@ -0,0 +1,252 @@
+#include "base/mapped_hash_table.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "base/crc32c.h"
+#include "base/eintr_wrapper.h"
+#include "base/hash.h"
+#include "base/logging.h"
+
+namespace {
+
+using base::internal::MappedHashTableSlot;
+
+const char kTableMagic[8] = { 'M', 'A', 'P', 'H', 'A', 'S', 'H', '1' };
+
+const uint64 kEmptySlot = kuint64max;
+
+// Layout of the file: the header, |num_slots| slots, then |records_size|
+// bytes of records.
+struct TableHeader {
+  char magic[8];
+  uint64 num_keys;
+  uint64 num_slots;  // A power of two.
+  uint64 records_size;
+  uint32 data_crc;    // CRC32C of the slots and the records.
+  uint32 header_crc;  // CRC32C of the header up to here.
+  char padding[24];
+};
+
+COMPILE_ASSERT(sizeof(TableHeader) == 64, table_header_size);
+
+const size_t kHeaderCrcSize = offsetof(TableHeader, header_crc);
+
+// A record: key size, value size, key, value.
+const size_t kRecordHeaderSize = 2 * sizeof(uint32);
+
+// log2 of the number of slots for |num_keys|, leaving a quarter of them
+// empty at least.
+int SlotBits(uint64 num_keys) {
+  int bits = 1;
+  while ((static_cast<uint64>(1) << bits) * 3 < num_keys * 4)
+    ++bits;
+  return bits;
+}
+
+// The key size of the record at |record|, which may be unaligned.
+uint32 RecordKeySize(const char* record) {
+  uint32 size;
+  memcpy(&size, record, sizeof(size));
+  return size;
+}
+
+bool WriteAll(FILE* file, const void* data, size_t size) {
+  return fwrite(data, 1, size, file) == size;
+}
+
+}  // namespace
+
+namespace base {
+
+MappedHashTableBuilder::MappedHashTableBuilder() {
+}
+
+MappedHashTableBuilder::~MappedHashTableBuilder() {
+}
+
+void MappedHashTableBuilder::Add(const StringPiece& key,
+                                 const StringPiece& value) {
+  CHECK_LE(key.size(), kuint32max) << "Key too long";
+  CHECK_LE(value.size(), kuint32max) << "Value too long";
+  const Entry entry = { Fingerprint(key), records_.size() };
+  entries_.push_back(entry);
+  const uint32 sizes[2] = { static_cast<uint32>(key.size()),
+                            static_cast<uint32>(value.size()) };
+  records_.append(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+  records_.append(key.data(), key.size());
+  records_.append(value.data(), value.size());
+}
+
+bool MappedHashTableBuilder::Finish(const std::string& path) {
+  const int bits = SlotBits(entries_.size());
+  const uint64 mask = (static_cast<uint64>(1) << bits) - 1;
+  std::vector<MappedHashTableSlot> slots(mask + 1);
+  for (size_t i = 0; i < slots.size(); ++i) {
+    slots[i].fingerprint = 0;
+    slots[i].offset = kEmptySlot;
+  }
+
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    const Entry& entry = entries_[i];
+    const StringPiece key(records_.data() + entry.offset + kRecordHeaderSize,
+                          RecordKeySize(records_.data() + entry.offset));
+    uint64 index = entry.fingerprint >> (64 - bits);
+    for (; slots[index].offset != kEmptySlot; index = (index + 1) & mask) {
+      const MappedHashTableSlot& slot = slots[index];
+      if (slot.fingerprint == entry.fingerprint &&
+          StringPiece(records_.data() + slot.offset + kRecordHeaderSize,
+                      RecordKeySize(records_.data() + slot.offset)) == key) {
+        LOG(ERROR) << "Key added twice to " << path << ": " << key;
+        return false;
+      }
+    }
+    slots[index].fingerprint = entry.fingerprint;
+    slots[index].offset = entry.offset;
+  }
+
+  TableHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kTableMagic, sizeof(kTableMagic));
+  header.num_keys = entries_.size();
+  header.num_slots = slots.size();
+  header.records_size = records_.size();
+  header.data_crc = Crc32cExtend(
+      Crc32c(&slots[0], slots.size() * sizeof(slots[0])),
+      records_.data(), records_.size());
+  header.header_crc = Crc32c(&header, kHeaderCrcSize);
+
+  const std::string temp_path = path + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (file == NULL) {
+    PLOG(ERROR) << "Cannot create " << temp_path;
+    return false;
+  }
+  bool ok = WriteAll(file, &header, sizeof(header)) &&
+            WriteAll(file, &slots[0], slots.size() * sizeof(slots[0])) &&
+            WriteAll(file, records_.data(), records_.size()) &&
+            fflush(file) == 0 && fsync(fileno(file)) == 0;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+    PLOG(ERROR) << "Cannot write " << path;
+    unlink(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+MappedHashTable::MappedHashTable()
+    : mapping_(NULL), mapping_size_(0), slots_(NULL), slot_mask_(0),
+      slot_shift_(64), records_(NULL), records_size_(0), size_(0),
+      data_crc_(0) {
+}
+
+MappedHashTable::~MappedHashTable() {
+  Close();
+}
+
+bool MappedHashTable::Open(const std::string& path) {
+  Close();
+  const int fd = HANDLE_EINTR(open(path.c_str(), O_RDONLY));
+  if (fd < 0)
+    return false;
+  struct stat st;
+  void* mapping = MAP_FAILED;
+  if (fstat(fd, &st) == 0 &&
+      st.st_size >= static_cast<off_t>(sizeof(TableHeader))) {
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return false;
+
+  const TableHeader* header = static_cast<const TableHeader*>(mapping);
+  const uint64 file_size = st.st_size;
+  const uint64 num_slots = header->num_slots;
+  const bool valid =
+      memcmp(header->magic, kTableMagic, sizeof(kTableMagic)) == 0 &&
+      header->header_crc == Crc32c(header, kHeaderCrcSize) &&
+      num_slots >= 2 && (num_slots & (num_slots - 1)) == 0 &&
+      header->num_keys < num_slots &&
+      num_slots <= (file_size - sizeof(TableHeader)) / sizeof(Slot) &&
+      header->records_size ==
+          file_size - sizeof(TableHeader) - num_slots * sizeof(Slot);
+  if (!valid) {
+    munmap(mapping, st.st_size);
+    return false;
+  }
+
+  // Lookups jump around the file; reading ahead would only waste memory.
+  madvise(mapping, st.st_size, MADV_RANDOM);
+  mapping_ = mapping;
+  mapping_size_ = st.st_size;
+  slots_ = reinterpret_cast<const Slot*>(header + 1);
+  slot_mask_ = num_slots - 1;
+  slot_shift_ = 64 - __builtin_ctzll(num_slots);
+  records_ = reinterpret_cast<const char*>(slots_ + num_slots);
+  records_size_ = header->records_size;
+  size_ = header->num_keys;
+  data_crc_ = header->data_crc;
+  return true;
+}
+
+void MappedHashTable::Close() {
+  if (mapping_)
+    munmap(mapping_, mapping_size_);
+  mapping_ = NULL;
+  mapping_size_ = 0;
+  slots_ = NULL;
+  slot_mask_ = 0;
+  slot_shift_ = 64;
+  records_ = NULL;
+  records_size_ = 0;
+  size_ = 0;
+  data_crc_ = 0;
+}
+
+bool MappedHashTable::Verify() const {
+  if (mapping_ == NULL)
+    return false;
+  return Crc32c(slots_, mapping_size_ - sizeof(TableHeader)) == data_crc_;
+}
+
+bool MappedHashTable::Find(const StringPiece& key, StringPiece* value) const {
+  if (slots_ == NULL)
+    return false;
+  const uint64 fp = Fingerprint(key);
+  uint64 index = fp >> slot_shift_;
+  // The table always has empty slots; the bound only guards corrupt files.
+  for (uint64 probes = 0; probes <= slot_mask_;
+       ++probes, index = (index + 1) & slot_mask_) {
+    const Slot& slot = slots_[index];
+    if (slot.offset == kEmptySlot)
+      return false;
+    if (slot.fingerprint != fp)
+      continue;
+    // Bounds checked, so a corrupt file cannot send reads off the mapping.
+    uint32 sizes[2];
+    if (slot.offset > records_size_ ||
+        records_size_ - slot.offset < kRecordHeaderSize) {
+      return false;
+    }
+    memcpy(sizes, records_ + slot.offset, sizeof(sizes));
+    const uint64 end = slot.offset + kRecordHeaderSize +
+                       static_cast<uint64>(sizes[0]) + sizes[1];
+    if (end > records_size_)
+      return false;
+    const char* record_key = records_ + slot.offset + kRecordHeaderSize;
+    if (StringPiece(record_key, sizes[0]) == key) {
+      if (value)
+        value->set(record_key + sizes[0], sizes[1]);
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace base
@@ -0,0 +1,114 @@
+// Description : Read-only hash table in a file, served straight from a
+//               shared memory mapping. The builder lays out an open
+//               addressing table of key fingerprints and offsets, followed
+//               by the keys and values, so opening the file costs one mmap()
+//               however big it is: there is nothing to parse, pages are read
+//               as lookups touch them, and processes mapping the same file
+//               share them in the page cache.
+//
+//               A lookup probes the table from the fingerprint of the key,
+//               linearly, at most 75% full, and compares the stored key of
+//               each fingerprint match, so fingerprint collisions are told
+//               apart. The file is native endian.
+//
+// Usage:
+//   base::MappedHashTableBuilder builder;
+//   builder.Add("apple", "red");
+//   if (!builder.Finish("/data/colors.mht")) ...
+//
+//   base::MappedHashTable colors;
+//   if (!colors.Open("/data/colors.mht")) ...
+//   base::StringPiece color;
+//   if (colors.Find("apple", &color)) ...
+
+#ifndef PUBLIC_BASE_MAPPED_HASH_TABLE_H_
+#define PUBLIC_BASE_MAPPED_HASH_TABLE_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/string_piece.h"
+
+namespace base {
+
+namespace internal {
+
+// An entry of the open addressing table of the file.
+struct MappedHashTableSlot {
+  uint64 fingerprint;
+  uint64 offset;  // Of the record of the key, or kuint64max if empty.
+};
+
+}  // namespace internal
+
+class MappedHashTableBuilder {
+ public:
+  MappedHashTableBuilder();
+  ~MappedHashTableBuilder();
+
+  // Adds |key| with |value|. Keys must be distinct, and keys and values
+  // under 4 GB. The builder holds all keys and values in memory until
+  // Finish().
+  void Add(const StringPiece& key, const StringPiece& value);
+
+  uint64 size() const { return entries_.size(); }
+
+  // Writes the table to |path|, through a temporary file renamed over it,
+  // so processes that mapped an older table keep reading it unchanged.
+  // Returns false if a key was added twice or the file cannot be written.
+  bool Finish(const std::string& path);
+
+ private:
+  struct Entry {
+    uint64 fingerprint;
+    uint64 offset;  // Of the record in |records_|.
+  };
+
+  std::vector<Entry> entries_;
+  // Records of (uint32 key size, uint32 value size, key, value).
+  std::string records_;
+
+  DISALLOW_COPY_AND_ASSIGN(MappedHashTableBuilder);
+};
+
+// Lookups are thread safe.
+class MappedHashTable {
+ public:
+  MappedHashTable();
+  ~MappedHashTable();
+
+  // Maps the table at |path|, replacing any table mapped before. Checks the
+  // header, not the contents; see Verify(). Returns false if |path| is not
+  // a table written by MappedHashTableBuilder.
+  bool Open(const std::string& path);
+  void Close();
+
+  // Reads the whole file to check its checksum.
+  bool Verify() const;
+
+  // Points |value| into the mapping, valid until Close(), and returns true
+  // if |key| is in the table.
+  bool Find(const StringPiece& key, StringPiece* value) const;
+
+  uint64 size() const { return size_; }
+
+ private:
+  typedef internal::MappedHashTableSlot Slot;
+
+  void* mapping_;
+  size_t mapping_size_;
+  const Slot* slots_;
+  uint64 slot_mask_;
+  int slot_shift_;
+  const char* records_;
+  uint64 records_size_;
+  uint64 size_;
+  uint32 data_crc_;
+
+  DISALLOW_COPY_AND_ASSIGN(MappedHashTable);
+};
+
+}  // namespace base
+
+#endif  // PUBLIC_BASE_MAPPED_HASH_TABLE_H_
@@ -4,6 +4,7 @@
 #ifndef PUBLIC_BASE_MUTEX_H_
 #define PUBLIC_BASE_MUTEX_H_
 
+#include <errno.h>
 #include <sys/time.h>
 
 #include "base/basictypes.h"
@@ -122,7 +123,8 @@ class CondVar {
   inline void Signal()   { BCHECK(pthread_cond_signal(&cv_) == 0) }
   inline void SignalAll(){ BCHECK(pthread_cond_broadcast(&cv_) == 0) }
 
-  inline void WaitWithTimeout(int ms) {
+  // Returns false if |ms| milliseconds passed without a signal.
+  inline bool WaitWithTimeout(int ms) {
     struct timeval now;
     struct timespec timeout;
     gettimeofday(&now, NULL);
@@ -132,7 +134,9 @@ class CondVar {
     timeout.tv_sec  = to / 1000000000LL;
     timeout.tv_nsec = to % 1000000000LL;
 
-    BCHECK(pthread_cond_timedwait(&cv_, mu_, &timeout) == 0)
+    const int rv = pthread_cond_timedwait(&cv_, mu_, &timeout);
+    BCHECK(rv == 0 || rv == ETIMEDOUT)
+    return rv == 0;
   }
 
  private:
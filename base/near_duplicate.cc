@@ -0,0 +1,185 @@
+#include "base/near_duplicate.h"
+
+#include <algorithm>
+
+#include "base/hash.h"
+#include "base/logging.h"
+
+namespace {
+
+// IMPORTANT: DON'T CHANGE THESE VALUES. Stored signatures depend on them.
+const uint32 kShingleSeed = 20120711;
+const uint32 kMinHashSeed = 20120712;
+
+inline bool IsSpace(char c) {
+  return c == ' ' || static_cast<uint8>(c - '\t') <= 4;
+}
+
+}  // namespace
+
+namespace base {
+
+void TokenShingles(const StringPiece& text, int shingle_size,
+                   std::vector<uint64>* shingles) {
+  DCHECK_GT(shingle_size, 0);
+  shingles->clear();
+
+  std::vector<StringPiece> tokens;
+  const char* p = text.data();
+  const char* const end = p + text.size();
+  while (p < end) {
+    while (p < end && IsSpace(*p))
+      ++p;
+    const char* token = p;
+    while (p < end && !IsSpace(*p))
+      ++p;
+    if (p > token)
+      tokens.push_back(StringPiece(token, p - token));
+  }
+  if (tokens.empty())
+    return;
+
+  std::vector<uint64> token_hashes(tokens.size());
+  FingerprintBatch(&tokens[0], tokens.size(), &token_hashes[0]);
+
+  const size_t width = std::min(static_cast<size_t>(shingle_size),
+                                tokens.size());
+  shingles->resize(tokens.size() - width + 1);
+  for (size_t i = 0; i < shingles->size(); ++i) {
+    (*shingles)[i] = MurmurHash64A(&token_hashes[i], width * sizeof(uint64),
+                                   kShingleSeed);
+  }
+}
+
+uint64 SimHash(const uint64* features, size_t n) {
+  // Counting the set bits, rather than adding +1 and -1 per bit, keeps the
+  // inner loop branch free so the compiler vectorizes it.
+  uint32 counts[64] = { 0 };
+  for (size_t i = 0; i < n; ++i) {
+    const uint64 feature = features[i];
+    for (int bit = 0; bit < 64; ++bit)
+      counts[bit] += (feature >> bit) & 1;
+  }
+  uint64 hash = 0;
+  for (int bit = 0; bit < 64; ++bit) {
+    if (2 * static_cast<uint64>(counts[bit]) > n)
+      hash |= static_cast<uint64>(1) << bit;
+  }
+  return hash;
+}
+
+uint64 SimHash(const StringPiece& text, int shingle_size) {
+  std::vector<uint64> shingles;
+  TokenShingles(text, shingle_size, &shingles);
+  return SimHash(shingles.empty() ? NULL : &shingles[0], shingles.size());
+}
+
+MinHasher::MinHasher(int num_hashes, uint64 seed)
+    : multipliers_(num_hashes),
+      offsets_(num_hashes) {
+  DCHECK_GT(num_hashes, 0);
+  for (int i = 0; i < num_hashes; ++i) {
+    uint64 key[2] = { seed, static_cast<uint64>(i) };
+    multipliers_[i] = MurmurHash64A(key, sizeof(key), kMinHashSeed) | 1;
+    key[1] += num_hashes;
+    offsets_[i] = MurmurHash64A(key, sizeof(key), kMinHashSeed);
+  }
+}
+
+void MinHasher::Compute(const uint64* shingles, size_t n,
+                        uint32* signature) const {
+  const int num_hashes = this->num_hashes();
+  const uint64* const multipliers = &multipliers_[0];
+  const uint64* const offsets = &offsets_[0];
+  for (int i = 0; i < num_hashes; ++i)
+    signature[i] = kuint32max;
+  // One pass over the shingles; the high half of a * x + b is a universal
+  // hash of x for a random odd a.
+  for (size_t s = 0; s < n; ++s) {
+    const uint64 x = shingles[s];
+    for (int i = 0; i < num_hashes; ++i) {
+      const uint32 value = static_cast<uint32>(
+          (multipliers[i] * x + offsets[i]) >> 32);
+      signature[i] = std::min(signature[i], value);
+    }
+  }
+}
+
+double MinHasher::EstimateJaccard(const uint32* a, const uint32* b,
+                                  int num_hashes) {
+  int equal = 0;
+  for (int i = 0; i < num_hashes; ++i)
+    equal += a[i] == b[i];
+  return num_hashes > 0 ? static_cast<double>(equal) / num_hashes : 0;
+}
+
+MinHashLshIndex::MinHashLshIndex(int num_bands, int rows_per_band)
+    : num_bands_(num_bands),
+      rows_per_band_(rows_per_band),
+      num_documents_(0),
+      bands_(num_bands) {
+  DCHECK_GT(num_bands, 0);
+  DCHECK_GT(rows_per_band, 0);
+}
+
+uint32 MinHashLshIndex::BandKey(const uint32* signature, int band) const {
+  return static_cast<uint32>(
+      MurmurHash64A(signature + band * rows_per_band_,
+                    rows_per_band_ * sizeof(uint32), band) >> 32);
+}
+
+uint32 MinHashLshIndex::Add(const uint32* signature) {
+  const uint32 document = num_documents_++;
+  for (int band = 0; band < num_bands_; ++band) {
+    bands_[band].push_back(
+        (static_cast<uint64>(BandKey(signature, band)) << 32) | document);
+  }
+  return document;
+}
+
+void MinHashLshIndex::Build() {
+  for (int band = 0; band < num_bands_; ++band)
+    std::sort(bands_[band].begin(), bands_[band].end());
+}
+
+void MinHashLshIndex::FindCandidates(const uint32* signature,
+                                     std::vector<uint32>* documents) const {
+  documents->clear();
+  for (int band = 0; band < num_bands_; ++band) {
+    const uint64 key = BandKey(signature, band);
+    const std::vector<uint64>& entries = bands_[band];
+    std::vector<uint64>::const_iterator it =
+        std::lower_bound(entries.begin(), entries.end(), key << 32);
+    for (; it != entries.end() && (*it >> 32) == key; ++it)
+      documents->push_back(static_cast<uint32>(*it));
+  }
+  std::sort(documents->begin(), documents->end());
+  documents->erase(std::unique(documents->begin(), documents->end()),
+                   documents->end());
+}
+
+void MinHashLshIndex::FindCandidatePairs(
+    std::vector<std::pair<uint32, uint32> >* pairs) const {
+  pairs->clear();
+  for (int band = 0; band < num_bands_; ++band) {
+    const std::vector<uint64>& entries = bands_[band];
+    size_t run_start = 0;
+    for (size_t i = 1; i <= entries.size(); ++i) {
+      if (i < entries.size() && (entries[i] >> 32) == (entries[i - 1] >> 32))
+        continue;
+      // Entries of a run are sorted by document, so each pair comes out
+      // with the smaller index first.
+      for (size_t a = run_start; a < i; ++a) {
+        for (size_t b = a + 1; b < i; ++b) {
+          pairs->push_back(std::make_pair(static_cast<uint32>(entries[a]),
+                                          static_cast<uint32>(entries[b])));
+        }
+      }
+      run_start = i;
+    }
+  }
+  std::sort(pairs->begin(), pairs->end());
+  pairs->erase(std::unique(pairs->begin(), pairs->end()), pairs->end());
+}
+
+}  // namespace base
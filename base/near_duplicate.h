@@ -0,0 +1,139 @@
+// Description : Near-duplicate detection for documents. A document is cut
+//               into shingles, runs of consecutive tokens, and summarized
+//               either by a 64-bit SimHash, where similar documents differ in
+//               few bits, or by a MinHash signature, whose matching values
+//               estimate the Jaccard similarity of the shingle sets.
+//               MinHashLshIndex finds the pairs of signatures likely to be
+//               similar without comparing all pairs.
+//
+// Usage:
+//   base::MinHasher hasher(128, 0);
+//   base::MinHashLshIndex index(32, 4);
+//   std::vector<uint64> shingles;
+//   std::vector<uint32> signature(hasher.num_hashes());
+//   for each document:
+//     base::TokenShingles(text, 3, &shingles);
+//     hasher.Compute(shingles, &signature[0]);
+//     index.Add(&signature[0]);  // Returns the document's index.
+//   index.Build();
+//   std::vector<std::pair<uint32, uint32> > pairs;
+//   index.FindCandidatePairs(&pairs);
+
+#ifndef PUBLIC_BASE_NEAR_DUPLICATE_H_
+#define PUBLIC_BASE_NEAR_DUPLICATE_H_
+
+#include <utility>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/string_piece.h"
+
+namespace base {
+
+// Replaces |shingles| with the hashes of each run of |shingle_size|
+// consecutive tokens of |text|, tokens being separated by ASCII whitespace.
+// A text with fewer tokens than |shingle_size| gives one shingle of all its
+// tokens, an empty text none.
+void TokenShingles(const StringPiece& text, int shingle_size,
+                   std::vector<uint64>* shingles);
+
+// SimHash of a set of feature hashes: bit b is set if it is set in more
+// than half of |features|.
+uint64 SimHash(const uint64* features, size_t n);
+
+// SimHash of the shingles of |text|.
+uint64 SimHash(const StringPiece& text, int shingle_size);
+
+// Number of differing bits between two SimHashes. Near duplicates are
+// usually within 3 bits.
+inline int SimHashDistance(uint64 a, uint64 b) {
+  return __builtin_popcountll(a ^ b);
+}
+
+// Computes MinHash signatures: value i of a signature is the minimum over
+// the shingles of the i-th hash function. The functions are
+// multiply-shift hashes of the shingle hashes, so all of them are computed
+// in one pass over the shingles.
+class MinHasher {
+ public:
+  // Signatures have |num_hashes| values. Signatures are only comparable if
+  // they come from hashers with the same arguments.
+  MinHasher(int num_hashes, uint64 seed);
+
+  int num_hashes() const { return static_cast<int>(multipliers_.size()); }
+
+  // Writes the signature of |n| shingle hashes to |signature|, which has
+  // room for num_hashes() values.
+  void Compute(const uint64* shingles, size_t n, uint32* signature) const;
+  void Compute(const std::vector<uint64>& shingles, uint32* signature) const {
+    Compute(shingles.empty() ? NULL : &shingles[0], shingles.size(),
+            signature);
+  }
+
+  // Estimates the Jaccard similarity of the shingle sets behind two
+  // signatures of |num_hashes| values.
+  static double EstimateJaccard(const uint32* a, const uint32* b,
+                                int num_hashes);
+
+ private:
+  std::vector<uint64> multipliers_;
+  std::vector<uint64> offsets_;
+
+  DISALLOW_COPY_AND_ASSIGN(MinHasher);
+};
+
+// Locality sensitive hashing over MinHash signatures. A signature is cut
+// into |num_bands| bands of |rows_per_band| values; two documents are
+// candidates if all values of at least one band are equal. Documents with
+// Jaccard similarity s become candidates with probability
+// 1 - (1 - s^rows_per_band)^num_bands, so more rows make the index stricter
+// and more bands make it more lenient.
+//
+// Each band of each document takes 8 bytes: 32 bands over ten million
+// documents fit in 2.5 GB. Bands are keyed by a 32-bit hash, so a few
+// unrelated documents become candidates too; check candidates against
+// their signatures.
+class MinHashLshIndex {
+ public:
+  MinHashLshIndex(int num_bands, int rows_per_band);
+
+  int num_bands() const { return num_bands_; }
+  int rows_per_band() const { return rows_per_band_; }
+  uint32 size() const { return num_documents_; }
+
+  // Adds a signature of num_bands() * rows_per_band() values. Returns the
+  // index of the document, counting from 0.
+  uint32 Add(const uint32* signature);
+
+  // Sorts the bands. Must be called after the last Add() and before the
+  // lookups below.
+  void Build();
+
+  // Replaces |documents| with the documents sharing a band with
+  // |signature|, in increasing order.
+  void FindCandidates(const uint32* signature,
+                      std::vector<uint32>* documents) const;
+
+  // Replaces |pairs| with each pair of documents sharing a band, once, the
+  // smaller index first, in increasing order. A band shared by m documents
+  // gives m * (m - 1) / 2 pairs, so drop empty documents before adding
+  // them.
+  void FindCandidatePairs(std::vector<std::pair<uint32, uint32> >* pairs)
+      const;
+
+ private:
+  uint32 BandKey(const uint32* signature, int band) const;
+
+  const int num_bands_;
+  const int rows_per_band_;
+  uint32 num_documents_;
+  // Per band, the band key in the high half and the document in the low
+  // half, sorted by Build().
+  std::vector<std::vector<uint64> > bands_;
+
+  DISALLOW_COPY_AND_ASSIGN(MinHashLshIndex);
+};
+
+}  // namespace base
+
+#endif  // PUBLIC_BASE_NEAR_DUPLICATE_H_
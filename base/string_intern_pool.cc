@@ -0,0 +1,158 @@
+#include "base/string_intern_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "base/hash.h"
+#include "base/logging.h"
+
+namespace {
+
+const uint64 kInitialSlots = 64;
+
+// Strings are copied into chunks of this size; longer ones than a quarter
+// of it get a chunk of their own, so little of a chunk is ever wasted.
+const size_t kChunkSize = 64 << 10;
+
+}  // namespace
+
+namespace base {
+
+StringInternPool::StringInternPool()
+    : table_(NewTable(kInitialSlots)), size_(0), chunk_free_(NULL),
+      chunk_remaining_(0), arena_bytes_(0) {
+  memset(segments_, 0, sizeof(segments_));
+}
+
+StringInternPool::~StringInternPool() {
+  free(table_);
+  for (size_t i = 0; i < old_tables_.size(); ++i)
+    free(old_tables_[i]);
+  for (int i = 0; i < kNumSegments; ++i)
+    delete[] segments_[i];
+  for (size_t i = 0; i < chunks_.size(); ++i)
+    delete[] chunks_[i];
+}
+
+StringInternPool::Table* StringInternPool::NewTable(uint64 num_slots) {
+  Table* table = static_cast<Table*>(
+      calloc(num_slots + 1, sizeof(uint64)));
+  CHECK(table);
+  table->mask = num_slots - 1;
+  return table;
+}
+
+bool StringInternPool::FindInTable(const Table* table, const StringPiece& str,
+                                   uint64 fp, uint32* id) const {
+  const uint64 tag = fp >> 32;
+  for (uint64 index = fp & table->mask;; index = (index + 1) & table->mask) {
+    const uint64 slot =
+        __atomic_load_n(&table->slots[index], __ATOMIC_ACQUIRE);
+    if (slot == 0)
+      return false;
+    if ((slot >> 32) == tag) {
+      const uint32 slot_id = static_cast<uint32>(slot) - 1;
+      if (Get(slot_id) == str) {
+        if (id)
+          *id = slot_id;
+        return true;
+      }
+    }
+  }
+}
+
+bool StringInternPool::Find(const StringPiece& str, uint32* id) const {
+  const Table* table = __atomic_load_n(&table_, __ATOMIC_ACQUIRE);
+  return FindInTable(table, str, Fingerprint(str), id);
+}
+
+StringPiece StringInternPool::Get(uint32 id) const {
+  const uint64 position = static_cast<uint64>(id) + (1 << kFirstSegmentBits);
+  const int segment = 63 - __builtin_clzll(position) - kFirstSegmentBits;
+  const StringPiece* pieces =
+      __atomic_load_n(&segments_[segment], __ATOMIC_ACQUIRE);
+  DCHECK(pieces != NULL);
+  return pieces[position - (static_cast<uint64>(1) <<
+                            (segment + kFirstSegmentBits))];
+}
+
+uint32 StringInternPool::InternId(const StringPiece& str) {
+  const uint64 fp = Fingerprint(str);
+  uint32 id;
+  if (FindInTable(__atomic_load_n(&table_, __ATOMIC_ACQUIRE), str, fp, &id))
+    return id;
+
+  MutexLock lock(&mutex_);
+  // Another thread may have added it since.
+  if (FindInTable(table_, str, fp, &id))
+    return id;
+  CHECK_LT(size_, kuint32max - 1) << "Too many strings interned";
+  if ((static_cast<uint64>(size_) + 1) * 2 > table_->mask + 1)
+    Grow();
+
+  // The piece is in place before the id is published, through the size and
+  // through the table slot, both with release stores.
+  id = size_;
+  const uint64 position = static_cast<uint64>(id) + (1 << kFirstSegmentBits);
+  const int segment = 63 - __builtin_clzll(position) - kFirstSegmentBits;
+  if (segments_[segment] == NULL) {
+    __atomic_store_n(
+        &segments_[segment],
+        new StringPiece[static_cast<size_t>(1) <<
+                        (segment + kFirstSegmentBits)],
+        __ATOMIC_RELEASE);
+  }
+  segments_[segment][position - (static_cast<uint64>(1) <<
+                                 (segment + kFirstSegmentBits))] =
+      CopyToArena(str);
+  __atomic_store_n(&size_, id + 1, __ATOMIC_RELEASE);
+
+  uint64 index = fp & table_->mask;
+  while (table_->slots[index] != 0)
+    index = (index + 1) & table_->mask;
+  __atomic_store_n(&table_->slots[index], (fp >> 32) << 32 | (id + 1),
+                   __ATOMIC_RELEASE);
+  return id;
+}
+
+void StringInternPool::Grow() {
+  Table* table = NewTable((table_->mask + 1) * 2);
+  for (uint32 id = 0; id < size_; ++id) {
+    const uint64 fp = Fingerprint(Get(id));
+    uint64 index = fp & table->mask;
+    while (table->slots[index] != 0)
+      index = (index + 1) & table->mask;
+    table->slots[index] = (fp >> 32) << 32 | (id + 1);
+  }
+  old_tables_.push_back(table_);
+  __atomic_store_n(&table_, table, __ATOMIC_RELEASE);
+}
+
+StringPiece StringInternPool::CopyToArena(const StringPiece& str) {
+  if (str.empty())
+    return StringPiece("", 0);
+  char* copy;
+  if (str.size() > kChunkSize / 4) {
+    copy = new char[str.size()];
+    chunks_.push_back(copy);
+  } else {
+    if (str.size() > chunk_remaining_) {
+      chunk_free_ = new char[kChunkSize];
+      chunk_remaining_ = kChunkSize;
+      chunks_.push_back(chunk_free_);
+    }
+    copy = chunk_free_;
+    chunk_free_ += str.size();
+    chunk_remaining_ -= str.size();
+  }
+  memcpy(copy, str.data(), str.size());
+  __atomic_store_n(&arena_bytes_, arena_bytes_ + str.size(),
+                   __ATOMIC_RELAXED);
+  return StringPiece(copy, str.size());
+}
+
+uint64 StringInternPool::arena_bytes() const {
+  return __atomic_load_n(&arena_bytes_, __ATOMIC_RELAXED);
+}
+
+}  // namespace base
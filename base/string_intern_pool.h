@@ -0,0 +1,97 @@
+// Description : Pool of interned strings shared between threads. Each
+//               distinct string is copied once into chunks of an arena that
+//               lives as long as the pool, so the StringPiece handed out for
+//               it stays valid, and equal strings get the same StringPiece
+//               and the same 32-bit id.
+//
+//               Strings are found through an open addressing table of
+//               fingerprints and ids, whose slots are single 64-bit words.
+//               Looking up a string already in the pool takes no lock:
+//               writers publish new slots with atomic stores, and a table
+//               outgrown by the pool is kept until the pool dies so readers
+//               still on it are safe. Adding a string takes a mutex.
+//
+// Usage:
+//   base::StringInternPool hosts;
+//   base::StringPiece host = hosts.Intern(url.host());
+//   uint32 id = hosts.InternId(url.host());
+//   ...
+//   LOG(INFO) << hosts.Get(id);
+
+#ifndef PUBLIC_BASE_STRING_INTERN_POOL_H_
+#define PUBLIC_BASE_STRING_INTERN_POOL_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/mutex.h"
+#include "base/string_piece.h"
+
+namespace base {
+
+class StringInternPool {
+ public:
+  StringInternPool();
+  ~StringInternPool();
+
+  // Returns the pooled copy of |str|, adding it if needed.
+  StringPiece Intern(const StringPiece& str) { return Get(InternId(str)); }
+
+  // Returns the id of |str|, adding it if needed. Ids are given out from 0
+  // in the order strings are added.
+  uint32 InternId(const StringPiece& str);
+
+  // Sets |id| to the id of |str| and returns true if |str| is in the pool.
+  // |id| may be NULL. Lock free.
+  bool Find(const StringPiece& str, uint32* id) const;
+
+  // The string of |id|, which must come from this pool. Lock free.
+  StringPiece Get(uint32 id) const;
+
+  // The number of strings in the pool.
+  uint32 size() const { return __atomic_load_n(&size_, __ATOMIC_ACQUIRE); }
+
+  // Bytes of string data held, not counting the tables.
+  uint64 arena_bytes() const;
+
+ private:
+  // A power of two number of slots, each (high half of the fingerprint
+  // << 32 | id + 1), or 0 if empty.
+  struct Table {
+    uint64 mask;
+    uint64 slots[1];
+  };
+
+  // The string of id i is in segment s, of 2^(s + kFirstSegmentBits)
+  // pieces, so segments never move and 32 bits of ids need few of them.
+  static const int kFirstSegmentBits = 10;
+  static const int kNumSegments = 33 - kFirstSegmentBits;
+
+  static Table* NewTable(uint64 num_slots);
+
+  // Returns the id of |str|, of fingerprint |fp|, if it is in |table|.
+  bool FindInTable(const Table* table, const StringPiece& str, uint64 fp,
+                   uint32* id) const;
+
+  // Locked.
+  StringPiece CopyToArena(const StringPiece& str);
+  void Grow();
+
+  Table* table_;
+  // Tables outgrown, kept for readers that may still use them.
+  std::vector<Table*> old_tables_;
+  StringPiece* segments_[kNumSegments];
+  uint32 size_;
+
+  Mutex mutex_;  // Held to add strings.
+  std::vector<char*> chunks_;
+  char* chunk_free_;
+  size_t chunk_remaining_;
+  uint64 arena_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(StringInternPool);
+};
+
+}  // namespace base
+
+#endif  // PUBLIC_BASE_STRING_INTERN_POOL_H_
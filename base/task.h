@@ -1,5 +1,9 @@
 #ifndef PUBLIC_BASE_TASK_H_
 #define PUBLIC_BASE_TASK_H_
+
+#include <functional>
+#include <memory>
+
 #include "base/basictypes.h"
 
 namespace base {
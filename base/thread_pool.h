@@ -1,9 +1,14 @@
 #ifndef PUBLIC_BASE_THREAD_POOL_H_
 #define PUBLIC_BASE_THREAD_POOL_H_
 
-#include "base/basic.h"
-#include "base/task.h"
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "base/basictypes.h"
 #include "base/concurrent_queue.h"
+#include "base/logging.h"
+#include "base/task.h"
 
 namespace base {
 
@@ -66,21 +71,32 @@ class ThreadPool {
     for (auto& th : workers) th.join();
   }
 
+  // The caller's logging::LogContext is captured here and installed on the
+  // worker thread while |task| runs.
   void AddTask(std::shared_ptr<Task> task) {
-    queue_.Push(task);
+    PendingTask pending;
+    pending.task = task;
+    pending.log_context = *logging::LogContext::Current();
+    queue_.Push(pending);
   }
 
  private:
+  struct PendingTask {
+    std::shared_ptr<Task> task;
+    logging::LogContext log_context;
+  };
+
   const int worker_num_;
-  FixedSizeConcurrentQueue<std::shared_ptr<Task>> queue_;
+  FixedSizeConQueue<PendingTask> queue_;
   std::vector<std::thread> workers;
 
   static void Work(ThreadPool *pool) {
-    std::shared_ptr<Task> task;
+    PendingTask pending;
     while (true) {
-      pool->queue_.Pop(task);
-      if (task == nullptr) return;
-      task->Run();
+      pool->queue_.Pop(pending);
+      if (pending.task == nullptr) return;
+      logging::ScopedLogContext scoped_log_context(pending.log_context);
+      pending.task->Run();
     }
   }
 
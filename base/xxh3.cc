@@ -0,0 +1,604 @@
+// XXH3 as specified by xxHash 0.8 (https://github.com/Cyan4973/xxHash),
+// 64 and 128-bit outputs with a seed and the default secret. Inputs up to
+// 240 bytes take scalar paths tuned for short keys; longer inputs go
+// through a striped accumulator, vectorized with SSE2, or AVX2 when the
+// processor supports it.
+
+#include "base/hash.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__)
+#include <immintrin.h>
+#include "base/atomicops.h"
+#endif
+
+namespace {
+
+const uint32 kPrime32_1 = 0x9E3779B1U;
+const uint32 kPrime32_2 = 0x85EBCA77U;
+const uint32 kPrime32_3 = 0xC2B2AE3DU;
+const uint64 kPrime64_1 = 0x9E3779B185EBCA87ULL;
+const uint64 kPrime64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64 kPrime64_3 = 0x165667B19E3779F9ULL;
+const uint64 kPrime64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64 kPrime64_5 = 0x27D4EB2F165667C5ULL;
+const uint64 kPrimeMx1 = 0x165667919E3779F9ULL;
+const uint64 kPrimeMx2 = 0x9FB21C651E98DF25ULL;
+
+const size_t kSecretSize = 192;
+const size_t kSecretSizeMin = 136;
+const size_t kStripeLen = 64;
+const size_t kSecretConsumeRate = 8;
+const size_t kAccNb = kStripeLen / sizeof(uint64);
+const size_t kMidSizeMax = 240;
+const size_t kMidSizeStartOffset = 3;
+const size_t kMidSizeLastOffset = 17;
+const size_t kSecretLastAccStart = 7;
+const size_t kSecretMergeAccsStart = 11;
+const size_t kStripesPerBlock =
+    (kSecretSize - kStripeLen) / kSecretConsumeRate;
+const size_t kBlockLen = kStripeLen * kStripesPerBlock;
+
+// IMPORTANT: DON'T CHANGE THESE VALUES. They are part of the XXH3 spec.
+const uint8 kSecret[kSecretSize] __attribute__((aligned(64))) = {
+  0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe,
+  0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+  0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+  0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+  0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78,
+  0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+  0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e,
+  0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+  0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+  0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+  0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e,
+  0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+  0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f,
+  0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+  0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+  0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+  0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3,
+  0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+  0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49,
+  0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+  0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+  0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+  0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28,
+  0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+// The spec reads all input little endian, which is what x86 loads do.
+inline uint32 Read32(const uint8* p) {
+  uint32 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64 Read64(const uint8* p) {
+  uint64 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline void Write64(uint8* p, uint64 v) {
+  memcpy(p, &v, sizeof(v));
+}
+
+inline uint32 Swap32(uint32 x) {
+  return __builtin_bswap32(x);
+}
+
+inline uint64 Swap64(uint64 x) {
+  return __builtin_bswap64(x);
+}
+
+inline uint32 Rotl32(uint32 x, int r) {
+  return (x << r) | (x >> (32 - r));
+}
+
+inline uint64 Rotl64(uint64 x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+inline void Mult64To128(uint64 a, uint64 b, uint64* low, uint64* high) {
+  const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+  *low = static_cast<uint64>(product);
+  *high = static_cast<uint64>(product >> 64);
+}
+
+inline uint64 Mul128Fold64(uint64 a, uint64 b) {
+  uint64 low;
+  uint64 high;
+  Mult64To128(a, b, &low, &high);
+  return low ^ high;
+}
+
+inline uint64 XorShift64(uint64 v, int shift) {
+  return v ^ (v >> shift);
+}
+
+inline uint64 XXH64Avalanche(uint64 h) {
+  h ^= h >> 33;
+  h *= kPrime64_2;
+  h ^= h >> 29;
+  h *= kPrime64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+inline uint64 Avalanche(uint64 h) {
+  h = XorShift64(h, 37);
+  h *= kPrimeMx1;
+  h = XorShift64(h, 32);
+  return h;
+}
+
+inline uint64 Rrmxmx(uint64 h, uint64 len) {
+  h ^= Rotl64(h, 49) ^ Rotl64(h, 24);
+  h *= kPrimeMx2;
+  h ^= (h >> 35) + len;
+  h *= kPrimeMx2;
+  return XorShift64(h, 28);
+}
+
+inline uint64 Mix16B(const uint8* input, const uint8* secret, uint64 seed) {
+  return Mul128Fold64(Read64(input) ^ (Read64(secret) + seed),
+                      Read64(input + 8) ^ (Read64(secret + 8) - seed));
+}
+
+// 0 to 16 bytes, 64-bit result.
+
+uint64 Len1To3_64(const uint8* input, size_t len, uint64 seed) {
+  const uint8 c1 = input[0];
+  const uint8 c2 = input[len >> 1];
+  const uint8 c3 = input[len - 1];
+  const uint32 combined = (static_cast<uint32>(c1) << 16) |
+                          (static_cast<uint32>(c2) << 24) |
+                          static_cast<uint32>(c3) |
+                          (static_cast<uint32>(len) << 8);
+  const uint64 bitflip = (Read32(kSecret) ^ Read32(kSecret + 4)) + seed;
+  return XXH64Avalanche(static_cast<uint64>(combined) ^ bitflip);
+}
+
+uint64 Len4To8_64(const uint8* input, size_t len, uint64 seed) {
+  seed ^= static_cast<uint64>(Swap32(static_cast<uint32>(seed))) << 32;
+  const uint32 input1 = Read32(input);
+  const uint32 input2 = Read32(input + len - 4);
+  const uint64 bitflip = (Read64(kSecret + 8) ^ Read64(kSecret + 16)) - seed;
+  const uint64 input64 = input2 + (static_cast<uint64>(input1) << 32);
+  return Rrmxmx(input64 ^ bitflip, len);
+}
+
+uint64 Len9To16_64(const uint8* input, size_t len, uint64 seed) {
+  const uint64 bitflip1 = (Read64(kSecret + 24) ^ Read64(kSecret + 32)) + seed;
+  const uint64 bitflip2 = (Read64(kSecret + 40) ^ Read64(kSecret + 48)) - seed;
+  const uint64 input_lo = Read64(input) ^ bitflip1;
+  const uint64 input_hi = Read64(input + len - 8) ^ bitflip2;
+  const uint64 acc = len + Swap64(input_lo) + input_hi +
+                     Mul128Fold64(input_lo, input_hi);
+  return Avalanche(acc);
+}
+
+uint64 Len0To16_64(const uint8* input, size_t len, uint64 seed) {
+  if (len > 8)
+    return Len9To16_64(input, len, seed);
+  if (len >= 4)
+    return Len4To8_64(input, len, seed);
+  if (len > 0)
+    return Len1To3_64(input, len, seed);
+  return XXH64Avalanche(seed ^ (Read64(kSecret + 56) ^ Read64(kSecret + 64)));
+}
+
+uint64 Len17To128_64(const uint8* input, size_t len, uint64 seed) {
+  uint64 acc = len * kPrime64_1;
+  if (len > 32) {
+    if (len > 64) {
+      if (len > 96) {
+        acc += Mix16B(input + 48, kSecret + 96, seed);
+        acc += Mix16B(input + len - 64, kSecret + 112, seed);
+      }
+      acc += Mix16B(input + 32, kSecret + 64, seed);
+      acc += Mix16B(input + len - 48, kSecret + 80, seed);
+    }
+    acc += Mix16B(input + 16, kSecret + 32, seed);
+    acc += Mix16B(input + len - 32, kSecret + 48, seed);
+  }
+  acc += Mix16B(input, kSecret, seed);
+  acc += Mix16B(input + len - 16, kSecret + 16, seed);
+  return Avalanche(acc);
+}
+
+uint64 Len129To240_64(const uint8* input, size_t len, uint64 seed) {
+  uint64 acc = len * kPrime64_1;
+  const size_t rounds = len / 16;
+  for (size_t i = 0; i < 8; ++i)
+    acc += Mix16B(input + 16 * i, kSecret + 16 * i, seed);
+  acc = Avalanche(acc);
+  for (size_t i = 8; i < rounds; ++i) {
+    acc += Mix16B(input + 16 * i, kSecret + 16 * (i - 8) + kMidSizeStartOffset,
+                  seed);
+  }
+  acc += Mix16B(input + len - 16,
+                kSecret + kSecretSizeMin - kMidSizeLastOffset, seed);
+  return Avalanche(acc);
+}
+
+// 0 to 16 bytes, 128-bit result.
+
+base::Hash128 Len1To3_128(const uint8* input, size_t len, uint64 seed) {
+  const uint8 c1 = input[0];
+  const uint8 c2 = input[len >> 1];
+  const uint8 c3 = input[len - 1];
+  const uint32 combinedl = (static_cast<uint32>(c1) << 16) |
+                           (static_cast<uint32>(c2) << 24) |
+                           static_cast<uint32>(c3) |
+                           (static_cast<uint32>(len) << 8);
+  const uint32 combinedh = Rotl32(Swap32(combinedl), 13);
+  const uint64 bitflipl = (Read32(kSecret) ^ Read32(kSecret + 4)) + seed;
+  const uint64 bitfliph = (Read32(kSecret + 8) ^ Read32(kSecret + 12)) - seed;
+  base::Hash128 h;
+  h.low = XXH64Avalanche(static_cast<uint64>(combinedl) ^ bitflipl);
+  h.high = XXH64Avalanche(static_cast<uint64>(combinedh) ^ bitfliph);
+  return h;
+}
+
+base::Hash128 Len4To8_128(const uint8* input, size_t len, uint64 seed) {
+  seed ^= static_cast<uint64>(Swap32(static_cast<uint32>(seed))) << 32;
+  const uint32 input_lo = Read32(input);
+  const uint32 input_hi = Read32(input + len - 4);
+  const uint64 input64 = input_lo + (static_cast<uint64>(input_hi) << 32);
+  const uint64 bitflip = (Read64(kSecret + 16) ^ Read64(kSecret + 24)) + seed;
+  const uint64 keyed = input64 ^ bitflip;
+
+  base::Hash128 h;
+  Mult64To128(keyed, kPrime64_1 + (len << 2), &h.low, &h.high);
+  h.high += h.low << 1;
+  h.low ^= h.high >> 3;
+  h.low = XorShift64(h.low, 35);
+  h.low *= kPrimeMx2;
+  h.low = XorShift64(h.low, 28);
+  h.high = Avalanche(h.high);
+  return h;
+}
+
+base::Hash128 Len9To16_128(const uint8* input, size_t len, uint64 seed) {
+  const uint64 bitflipl = (Read64(kSecret + 32) ^ Read64(kSecret + 40)) - seed;
+  const uint64 bitfliph = (Read64(kSecret + 48) ^ Read64(kSecret + 56)) + seed;
+  const uint64 input_lo = Read64(input);
+  uint64 input_hi = Read64(input + len - 8);
+
+  uint64 m_low;
+  uint64 m_high;
+  Mult64To128(input_lo ^ input_hi ^ bitflipl, kPrime64_1, &m_low, &m_high);
+  m_low += static_cast<uint64>(len - 1) << 54;
+  input_hi ^= bitfliph;
+  m_high += input_hi +
+            static_cast<uint64>(static_cast<uint32>(input_hi)) *
+                (kPrime32_2 - 1);
+  m_low ^= Swap64(m_high);
+
+  base::Hash128 h;
+  Mult64To128(m_low, kPrime64_2, &h.low, &h.high);
+  h.high += m_high * kPrime64_2;
+  h.low = Avalanche(h.low);
+  h.high = Avalanche(h.high);
+  return h;
+}
+
+base::Hash128 Len0To16_128(const uint8* input, size_t len, uint64 seed) {
+  if (len > 8)
+    return Len9To16_128(input, len, seed);
+  if (len >= 4)
+    return Len4To8_128(input, len, seed);
+  if (len > 0)
+    return Len1To3_128(input, len, seed);
+  base::Hash128 h;
+  h.low = XXH64Avalanche(seed ^ Read64(kSecret + 64) ^ Read64(kSecret + 72));
+  h.high = XXH64Avalanche(seed ^ Read64(kSecret + 80) ^ Read64(kSecret + 88));
+  return h;
+}
+
+inline void Mix32B(base::Hash128* acc, const uint8* input_1,
+                   const uint8* input_2, const uint8* secret, uint64 seed) {
+  acc->low += Mix16B(input_1, secret, seed);
+  acc->low ^= Read64(input_2) + Read64(input_2 + 8);
+  acc->high += Mix16B(input_2, secret + 16, seed);
+  acc->high ^= Read64(input_1) + Read64(input_1 + 8);
+}
+
+base::Hash128 FinishMidSize128(const base::Hash128& acc, size_t len,
+                               uint64 seed) {
+  base::Hash128 h;
+  h.low = Avalanche(acc.low + acc.high);
+  h.high = 0 - Avalanche(acc.low * kPrime64_1 + acc.high * kPrime64_4 +
+                         (len - seed) * kPrime64_2);
+  return h;
+}
+
+base::Hash128 Len17To128_128(const uint8* input, size_t len, uint64 seed) {
+  base::Hash128 acc;
+  acc.low = len * kPrime64_1;
+  acc.high = 0;
+  if (len > 32) {
+    if (len > 64) {
+      if (len > 96)
+        Mix32B(&acc, input + 48, input + len - 64, kSecret + 96, seed);
+      Mix32B(&acc, input + 32, input + len - 48, kSecret + 64, seed);
+    }
+    Mix32B(&acc, input + 16, input + len - 32, kSecret + 32, seed);
+  }
+  Mix32B(&acc, input, input + len - 16, kSecret, seed);
+  return FinishMidSize128(acc, len, seed);
+}
+
+base::Hash128 Len129To240_128(const uint8* input, size_t len, uint64 seed) {
+  base::Hash128 acc;
+  acc.low = len * kPrime64_1;
+  acc.high = 0;
+  size_t i = 32;
+  for (; i < 160; i += 32)
+    Mix32B(&acc, input + i - 32, input + i - 16, kSecret + i - 32, seed);
+  acc.low = Avalanche(acc.low);
+  acc.high = Avalanche(acc.high);
+  for (; i <= len; i += 32) {
+    Mix32B(&acc, input + i - 32, input + i - 16,
+           kSecret + kMidSizeStartOffset + i - 160, seed);
+  }
+  Mix32B(&acc, input + len - 16, input + len - 32,
+         kSecret + kSecretSizeMin - kMidSizeLastOffset - 16, 0 - seed);
+  return FinishMidSize128(acc, len, seed);
+}
+
+// Long inputs. Each 64-byte stripe is folded into eight 64-bit lanes; the
+// lanes are scrambled after every block of kStripesPerBlock stripes.
+
+// Defines |name|, which runs the stripe loop of a long input over |acc|
+// with the given kernels. A macro rather than a template, so each copy can
+// be compiled for the instruction set of its kernels.
+#define DEFINE_HASH_LONG_LOOP(name, accumulate_512, scramble)                 \
+  void name(uint64* acc, const uint8* input, size_t len,                      \
+            const uint8* secret) {                                            \
+    const size_t blocks = (len - 1) / kBlockLen;                              \
+    for (size_t n = 0; n < blocks; ++n) {                                     \
+      const uint8* block = input + n * kBlockLen;                             \
+      for (size_t s = 0; s < kStripesPerBlock; ++s) {                         \
+        accumulate_512(acc, block + s * kStripeLen,                           \
+                       secret + s * kSecretConsumeRate);                      \
+      }                                                                       \
+      scramble(acc, secret + kSecretSize - kStripeLen);                       \
+    }                                                                         \
+    const size_t stripes = ((len - 1) - kBlockLen * blocks) / kStripeLen;     \
+    const uint8* block = input + blocks * kBlockLen;                          \
+    for (size_t s = 0; s < stripes; ++s) {                                    \
+      accumulate_512(acc, block + s * kStripeLen,                             \
+                     secret + s * kSecretConsumeRate);                        \
+    }                                                                         \
+    accumulate_512(acc, input + len - kStripeLen,                             \
+                   secret + kSecretSize - kStripeLen - kSecretLastAccStart);  \
+  }
+
+#if !defined(__SSE2__)
+void Accumulate512Scalar(uint64* acc, const uint8* input,
+                         const uint8* secret) {
+  for (size_t i = 0; i < kAccNb; ++i) {
+    const uint64 data_val = Read64(input + 8 * i);
+    const uint64 data_key = data_val ^ Read64(secret + 8 * i);
+    acc[i ^ 1] += data_val;
+    acc[i] += static_cast<uint64>(static_cast<uint32>(data_key)) *
+              (data_key >> 32);
+  }
+}
+
+void ScrambleScalar(uint64* acc, const uint8* secret) {
+  for (size_t i = 0; i < kAccNb; ++i) {
+    uint64 acc64 = acc[i];
+    acc64 = XorShift64(acc64, 47);
+    acc64 ^= Read64(secret + 8 * i);
+    acc64 *= kPrime32_1;
+    acc[i] = acc64;
+  }
+}
+
+DEFINE_HASH_LONG_LOOP(HashLongLoopScalar, Accumulate512Scalar, ScrambleScalar)
+#endif  // !__SSE2__
+
+#if defined(__SSE2__)
+inline void Accumulate512Sse2(uint64* acc, const uint8* input,
+                              const uint8* secret) {
+  __m128i* const xacc = reinterpret_cast<__m128i*>(acc);
+  for (size_t i = 0; i < kStripeLen / sizeof(__m128i); ++i) {
+    const __m128i data_vec = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(input) + i);
+    const __m128i key_vec = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(secret) + i);
+    const __m128i data_key = _mm_xor_si128(data_vec, key_vec);
+    const __m128i data_key_lo = _mm_shuffle_epi32(data_key,
+                                                  _MM_SHUFFLE(0, 3, 0, 1));
+    const __m128i product = _mm_mul_epu32(data_key, data_key_lo);
+    const __m128i data_swap = _mm_shuffle_epi32(data_vec,
+                                                _MM_SHUFFLE(1, 0, 3, 2));
+    const __m128i sum = _mm_add_epi64(_mm_load_si128(xacc + i), data_swap);
+    _mm_store_si128(xacc + i, _mm_add_epi64(product, sum));
+  }
+}
+
+inline void ScrambleSse2(uint64* acc, const uint8* secret) {
+  __m128i* const xacc = reinterpret_cast<__m128i*>(acc);
+  const __m128i prime32 = _mm_set1_epi32(static_cast<int>(kPrime32_1));
+  for (size_t i = 0; i < kStripeLen / sizeof(__m128i); ++i) {
+    const __m128i acc_vec = _mm_load_si128(xacc + i);
+    const __m128i data_vec = _mm_xor_si128(acc_vec,
+                                           _mm_srli_epi64(acc_vec, 47));
+    const __m128i key_vec = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(secret) + i);
+    const __m128i data_key = _mm_xor_si128(data_vec, key_vec);
+    const __m128i data_key_hi = _mm_shuffle_epi32(data_key,
+                                                  _MM_SHUFFLE(0, 3, 0, 1));
+    const __m128i product_lo = _mm_mul_epu32(data_key, prime32);
+    const __m128i product_hi = _mm_mul_epu32(data_key_hi, prime32);
+    _mm_store_si128(xacc + i, _mm_add_epi64(product_lo,
+                                            _mm_slli_epi64(product_hi, 32)));
+  }
+}
+
+DEFINE_HASH_LONG_LOOP(HashLongLoopSse2, Accumulate512Sse2, ScrambleSse2)
+#endif  // __SSE2__
+
+#if defined(__x86_64__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+inline void Accumulate512Avx2(uint64* acc, const uint8* input,
+                              const uint8* secret) {
+  __m256i* const xacc = reinterpret_cast<__m256i*>(acc);
+  for (size_t i = 0; i < kStripeLen / sizeof(__m256i); ++i) {
+    const __m256i data_vec = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(input) + i);
+    const __m256i key_vec = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(secret) + i);
+    const __m256i data_key = _mm256_xor_si256(data_vec, key_vec);
+    const __m256i data_key_lo = _mm256_shuffle_epi32(data_key,
+                                                     _MM_SHUFFLE(0, 3, 0, 1));
+    const __m256i product = _mm256_mul_epu32(data_key, data_key_lo);
+    const __m256i data_swap = _mm256_shuffle_epi32(data_vec,
+                                                   _MM_SHUFFLE(1, 0, 3, 2));
+    const __m256i sum = _mm256_add_epi64(_mm256_load_si256(xacc + i),
+                                         data_swap);
+    _mm256_store_si256(xacc + i, _mm256_add_epi64(product, sum));
+  }
+}
+
+inline void ScrambleAvx2(uint64* acc, const uint8* secret) {
+  __m256i* const xacc = reinterpret_cast<__m256i*>(acc);
+  const __m256i prime32 = _mm256_set1_epi32(static_cast<int>(kPrime32_1));
+  for (size_t i = 0; i < kStripeLen / sizeof(__m256i); ++i) {
+    const __m256i acc_vec = _mm256_load_si256(xacc + i);
+    const __m256i data_vec = _mm256_xor_si256(acc_vec,
+                                              _mm256_srli_epi64(acc_vec, 47));
+    const __m256i key_vec = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(secret) + i);
+    const __m256i data_key = _mm256_xor_si256(data_vec, key_vec);
+    const __m256i data_key_hi = _mm256_shuffle_epi32(data_key,
+                                                     _MM_SHUFFLE(0, 3, 0, 1));
+    const __m256i product_lo = _mm256_mul_epu32(data_key, prime32);
+    const __m256i product_hi = _mm256_mul_epu32(data_key_hi, prime32);
+    _mm256_store_si256(xacc + i,
+                       _mm256_add_epi64(product_lo,
+                                        _mm256_slli_epi64(product_hi, 32)));
+  }
+}
+
+DEFINE_HASH_LONG_LOOP(HashLongLoopAvx2, Accumulate512Avx2, ScrambleAvx2)
+
+#pragma GCC pop_options
+#endif  // __x86_64__
+
+#undef DEFINE_HASH_LONG_LOOP
+
+// Runs the stripe loop with the widest kernel the processor supports.
+void HashLongLoop(uint64* acc, const uint8* input, size_t len,
+                  const uint8* secret) {
+#if defined(__x86_64__)
+  // Checked on every call: the flag is set by a static initializer that may
+  // not have run yet, and it is only a load.
+  if (AtomicOps_Internalx86CPUFeatures.has_avx2) {
+    HashLongLoopAvx2(acc, input, len, secret);
+    return;
+  }
+#endif
+#if defined(__SSE2__)
+  HashLongLoopSse2(acc, input, len, secret);
+#else
+  HashLongLoopScalar(acc, input, len, secret);
+#endif
+}
+
+inline void InitAccumulators(uint64* acc) {
+  acc[0] = kPrime32_3;
+  acc[1] = kPrime64_1;
+  acc[2] = kPrime64_2;
+  acc[3] = kPrime64_3;
+  acc[4] = kPrime64_4;
+  acc[5] = kPrime32_2;
+  acc[6] = kPrime64_5;
+  acc[7] = kPrime32_1;
+}
+
+// Returns the secret for |seed|: the default one for 0, otherwise a copy
+// with the seed added to and subtracted from alternate words, in |custom|.
+const uint8* SecretForSeed(uint64 seed, uint8* custom) {
+  if (seed == 0)
+    return kSecret;
+  for (size_t i = 0; i < kSecretSize / 16; ++i) {
+    Write64(custom + 16 * i, Read64(kSecret + 16 * i) + seed);
+    Write64(custom + 16 * i + 8, Read64(kSecret + 16 * i + 8) - seed);
+  }
+  return custom;
+}
+
+uint64 MergeAccumulators(const uint64* acc, const uint8* secret,
+                         uint64 start) {
+  uint64 result = start;
+  for (size_t i = 0; i < 4; ++i) {
+    result += Mul128Fold64(acc[2 * i] ^ Read64(secret + 16 * i),
+                           acc[2 * i + 1] ^ Read64(secret + 16 * i + 8));
+  }
+  return Avalanche(result);
+}
+
+uint64 HashLong64(const uint8* input, size_t len, uint64 seed) {
+  uint8 custom[kSecretSize] __attribute__((aligned(64)));
+  const uint8* secret = SecretForSeed(seed, custom);
+  uint64 acc[kAccNb] __attribute__((aligned(64)));
+  InitAccumulators(acc);
+  HashLongLoop(acc, input, len, secret);
+  return MergeAccumulators(acc, secret + kSecretMergeAccsStart,
+                           len * kPrime64_1);
+}
+
+base::Hash128 HashLong128(const uint8* input, size_t len, uint64 seed) {
+  uint8 custom[kSecretSize] __attribute__((aligned(64)));
+  const uint8* secret = SecretForSeed(seed, custom);
+  uint64 acc[kAccNb] __attribute__((aligned(64)));
+  InitAccumulators(acc);
+  HashLongLoop(acc, input, len, secret);
+  base::Hash128 h;
+  h.low = MergeAccumulators(acc, secret + kSecretMergeAccsStart,
+                            len * kPrime64_1);
+  h.high = MergeAccumulators(
+      acc, secret + kSecretSize - kStripeLen - kSecretMergeAccsStart,
+      ~(len * kPrime64_2));
+  return h;
+}
+
+}  // namespace
+
+namespace base {
+
+uint64 XXH3Hash64(const void* key, size_t len, uint64 seed) {
+  const uint8* input = static_cast<const uint8*>(key);
+  if (len <= 16)
+    return Len0To16_64(input, len, seed);
+  if (len <= 128)
+    return Len17To128_64(input, len, seed);
+  if (len <= kMidSizeMax)
+    return Len129To240_64(input, len, seed);
+  return HashLong64(input, len, seed);
+}
+
+Hash128 XXH3Hash128(const void* key, size_t len, uint64 seed) {
+  const uint8* input = static_cast<const uint8*>(key);
+  if (len <= 16)
+    return Len0To16_128(input, len, seed);
+  if (len <= 128)
+    return Len17To128_128(input, len, seed);
+  if (len <= kMidSizeMax)
+    return Len129To240_128(input, len, seed);
+  return HashLong128(input, len, seed);
+}
+
+}  // namespace base